@@ -0,0 +1,501 @@
+/*
+  Кобзев Антон АПО-11
+
+  Задача №1
+  Замеры скорости divfmt на сгенерированной разметке. Этапы чтения, разбора на токены, форматирования и записи
+  измеряются отдельно, результат печатается в CSV
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "divfmt.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NULL_DEVICE "/dev/null"
+#define HAVE_MONOTONIC_CLOCK
+#else
+#define NULL_DEVICE "NUL"
+#endif
+
+#define MEGABYTE (1024.0 * 1024.0)
+
+#define DEFAULT_SIZE_MB 16
+#define DEFAULT_REPEATS 3
+#define DEFAULT_THREADS 4
+#define DEFAULT_CHECKPOINT_INTERVAL 65536
+#define EDITS_COUNT 100
+#define PAGE_SIZE_BYTES 4096  // Smallest usual page, larger pages are just touched several times
+
+#define SIZE_OPTION "--size"
+#define REPEAT_OPTION "--repeat"
+#define THREADS_OPTION "--threads"
+#define SEED_OPTION "--seed"
+#define CORPUS_OPTION "--corpus"
+#define DEPTH_OPTION "--depth"
+#define TEXT_OPTION "--text"
+#define SPACES_OPTION "--spaces"
+#define DEFECT_OPTION "--defect"
+#define OUTPUT_OPTION "--output"
+
+#define CSV_HEADER "corpus,bytes,valid,mode,stage,seconds,mb_per_s,allocations,allocations_per_mb,build_type\n"
+
+// Set by CMakeLists.txt, so that numbers of unoptimized builds are told apart
+#ifndef BUILD_TYPE
+#define BUILD_TYPE "unknown"
+#endif
+
+// Defect is put into the middle of the corpus, so validation has to get there
+typedef enum { DEFECT_NONE, DEFECT_UNCLOSED, DEFECT_STRAY_CLOSE, DEFECT_MISMATCH, DEFECT_BROKEN_TAG } defect;
+
+static const char *const defect_names[] = {"none", "unclosed", "stray_close", "mismatch", "broken_tag"};
+
+typedef struct {
+  const char *name;
+  size_t depth;  // Most nested open tags
+  size_t text_length;  // Average length of a text run
+  double spaces;  // Share of whitespace in text runs and between tokens
+  defect defect;
+} corpus_options;
+
+static const corpus_options default_corpora[] = {
+  {"flat", 1, 40, 0.15, DEFECT_NONE},
+  {"nested", 16, 24, 0.15, DEFECT_NONE},
+  {"deep", 256, 8, 0.1, DEFECT_NONE},
+  {"long_text", 4, 400, 0.15, DEFECT_NONE},
+  {"whitespace", 8, 24, 0.6, DEFECT_NONE},
+  {"tags_only", 16, 0, 0.05, DEFECT_NONE},
+  {"unclosed", 16, 24, 0.15, DEFECT_UNCLOSED},
+  {"stray_close", 16, 24, 0.15, DEFECT_STRAY_CLOSE},
+  {"mismatch", 16, 24, 0.15, DEFECT_MISMATCH},
+  {"broken_tag", 16, 24, 0.15, DEFECT_BROKEN_TAG}
+};
+
+typedef struct {
+  size_t size;
+  size_t repeats;
+  size_t threads_count;
+  unsigned long long seed;
+  const char *output;  // Formatted output is written here
+} bench_options;
+
+/* Time and allocations of the fastest of repeated runs */
+typedef struct {
+  double seconds;
+  size_t allocations;
+} measure;
+
+#ifdef COUNT_ALLOCATIONS
+// Calls of divfmt are wrapped by the linker, see CMakeLists.txt
+static size_t allocations_count;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocations_count++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  allocations_count++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+  allocations_count++;
+  return __real_realloc(pointer, size);
+}
+#endif
+
+size_t get_allocations();
+
+double get_time();
+
+void touch_pages(const input_buffer *input);
+
+unsigned long long next_random(unsigned long long *state);
+
+double random_share(unsigned long long *state);
+
+bool generate_corpus(const corpus_options *options, size_t size, unsigned long long seed, input_buffer *corpus);
+
+void add_defect(input_buffer *corpus, defect defect);
+
+bool append_chars(input_buffer *buffer, const char *s, size_t size);
+
+void append_spaces(input_buffer *buffer, double spaces, unsigned long long *state);
+
+void print_row(const corpus_options *options, size_t size, bool is_valid, const char *mode, const char *stage,
+               measure value, size_t processed);
+
+bool bench_corpus(const corpus_options *options, const bench_options *bench);
+
+int main(int argc, char **argv) {
+  bench_options bench = {(size_t) (DEFAULT_SIZE_MB * MEGABYTE), DEFAULT_REPEATS, DEFAULT_THREADS, 1, NULL_DEVICE};
+  corpus_options custom = default_corpora[1];
+  custom.name = "custom";
+  bool is_custom = false;
+  const char *corpus_name = NULL;
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 == argc) {
+      fprintf(stderr, "Missing value of option %s\n", argv[i]);
+      return 1;
+    }
+    const char *value = argv[i + 1];
+    if (strcmp(argv[i], SIZE_OPTION) == 0) {
+      bench.size = (size_t) (strtod(value, NULL) * MEGABYTE);
+    } else if (strcmp(argv[i], REPEAT_OPTION) == 0) {
+      bench.repeats = strtoul(value, NULL, 10);
+    } else if (strcmp(argv[i], THREADS_OPTION) == 0) {
+      bench.threads_count = strtoul(value, NULL, 10);
+    } else if (strcmp(argv[i], SEED_OPTION) == 0) {
+      bench.seed = strtoull(value, NULL, 10);
+    } else if (strcmp(argv[i], OUTPUT_OPTION) == 0) {
+      bench.output = value;
+    } else if (strcmp(argv[i], CORPUS_OPTION) == 0) {
+      corpus_name = value;
+    } else if (strcmp(argv[i], DEPTH_OPTION) == 0) {
+      custom.depth = strtoul(value, NULL, 10);
+      is_custom = true;
+    } else if (strcmp(argv[i], TEXT_OPTION) == 0) {
+      custom.text_length = strtoul(value, NULL, 10);
+      is_custom = true;
+    } else if (strcmp(argv[i], SPACES_OPTION) == 0) {
+      custom.spaces = strtod(value, NULL);
+      is_custom = true;
+    } else if (strcmp(argv[i], DEFECT_OPTION) == 0) {
+      size_t j = 0;
+      while (j < sizeof(defect_names) / sizeof(defect_names[0]) && strcmp(value, defect_names[j]) != 0)
+        j++;
+      if (j == sizeof(defect_names) / sizeof(defect_names[0])) {
+        fprintf(stderr, "Unknown defect %s\n", value);
+        return 1;
+      }
+      custom.defect = (defect) j;
+      is_custom = true;
+    } else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (bench.repeats == 0) bench.repeats = 1;
+  if (bench.threads_count == 0) bench.threads_count = 1;
+  if (bench.threads_count > MAX_THREADS_COUNT) bench.threads_count = MAX_THREADS_COUNT;
+  if (custom.spaces < 0) custom.spaces = 0;
+  if (custom.spaces > 0.95) custom.spaces = 0.95;
+
+  size_t corpora_count = sizeof(default_corpora) / sizeof(default_corpora[0]), first_corpus = 0;
+  if (corpus_name != NULL) {
+    if (is_custom) {
+      fprintf(stderr, "Option %s can't be combined with options of a custom corpus\n", CORPUS_OPTION);
+      return 1;
+    }
+    while (first_corpus < corpora_count && strcmp(corpus_name, default_corpora[first_corpus].name) != 0)
+      first_corpus++;
+    if (first_corpus == corpora_count) {
+      fprintf(stderr, "Unknown corpus %s\n", corpus_name);
+      return 1;
+    }
+    corpora_count = first_corpus + 1;
+  }
+
+  fputs(CSV_HEADER, stdout);
+  if (is_custom)
+    return bench_corpus(&custom, &bench) ? 0 : 1;
+  for (size_t i = first_corpus; i < corpora_count; ++i)
+    if (!bench_corpus(&default_corpora[i], &bench)) return 1;
+  return 0;
+}
+
+size_t get_allocations() {
+#ifdef COUNT_ALLOCATIONS
+  return allocations_count;
+#else
+  return 0;
+#endif
+}
+
+double get_time() {
+#ifdef HAVE_MONOTONIC_CLOCK
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (double) time.tv_sec + (double) time.tv_nsec * 1e-9;
+#else
+  return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Faults a mapped input in, so that the read stage and not tokenize pays for it */
+void touch_pages(const input_buffer *input) {
+  volatile unsigned char sum = 0;
+  for (size_t i = 0; i < input->size; i += PAGE_SIZE_BYTES)
+    sum += (unsigned char) input->content[i];
+}
+
+/* xorshift64*, corpora are the same for the same seed on every platform */
+unsigned long long next_random(unsigned long long *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ull;
+}
+
+/* Returns random number in [0, 1) */
+double random_share(unsigned long long *state) { return (double) (next_random(state) >> 11) / 9007199254740992.0; }
+
+/* Returns true on success */
+bool append_chars(input_buffer *buffer, const char *s, size_t size) {
+  if (buffer->size + size > buffer->capacity) {
+    size_t new_capacity = buffer->capacity == 0 ? 4096 : buffer->capacity * 2;
+    while (new_capacity < buffer->size + size)
+      new_capacity *= 2;
+    char *new_content = realloc(buffer->content, new_capacity);
+    if (new_content == NULL) return false;
+    buffer->content = new_content;
+    buffer->capacity = new_capacity;
+  }
+  memcpy(buffer->content + buffer->size, s, size);
+  buffer->size += size;
+  return true;
+}
+
+/* Appends whitespace between tokens, its length grows with spaces share */
+void append_spaces(input_buffer *buffer, double spaces, unsigned long long *state) {
+  static const char whitespace[] = "  \t \n ";
+  while (random_share(state) < spaces) {
+    char c = whitespace[next_random(state) % (sizeof(whitespace) - 1)];
+    append_chars(buffer, &c, 1);
+  }
+}
+
+/* Generates size bytes or a bit more of markup, returns true on success */
+bool generate_corpus(const corpus_options *options, size_t size, unsigned long long seed, input_buffer *corpus) {
+  static const char *const names[] = {"div", "span", "p", "section", "a"};
+  static const char *const attributes[] = {" class=\"item\"", " id='n1'", " data-x=\"a > b\"", " hidden"};
+  static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+  const size_t names_count = sizeof(names) / sizeof(names[0]);
+  unsigned long long state = seed * 0x9E3779B97F4A7C15ull + 1;
+  size_t *stack = malloc((options->depth + 1) * sizeof(size_t));
+  if (stack == NULL) return false;
+  size_t depth = 0;
+  *corpus = (input_buffer) INPUT_BUFFER_INITIALIZER;
+  bool success = true;
+  char tag[64];
+  while (success && (corpus->size < size || depth > 0)) {
+    double action = random_share(&state);
+    bool is_ending = corpus->size >= size;
+    if (!is_ending && depth < options->depth && action < 0.35) {
+      size_t name = next_random(&state) % names_count;
+      const char *attribute = random_share(&state) < 0.3 ? attributes[next_random(&state) % 4] : "";
+      int length = snprintf(tag, sizeof(tag), "<%s%s>", names[name], attribute);
+      success = append_chars(corpus, tag, (size_t) length);
+      stack[depth++] = name;
+    } else if (depth > 0 && (is_ending || action < 0.7 || options->text_length == 0)) {
+      int length = snprintf(tag, sizeof(tag), "</%s>", names[stack[--depth]]);
+      success = append_chars(corpus, tag, (size_t) length);
+    } else if (options->text_length != 0) {
+      size_t length = 1 + next_random(&state) % (2 * options->text_length);
+      for (size_t i = 0; success && i < length; ++i) {
+        char c = random_share(&state) < options->spaces ? ' ' : letters[next_random(&state) % 26];
+        success = append_chars(corpus, &c, 1);
+      }
+    } else if (random_share(&state) < 0.5) {
+      success = append_chars(corpus, "<br/>", 5);
+    }
+    append_spaces(corpus, options->spaces, &state);
+    if (success && random_share(&state) < 0.5)
+      success = append_chars(corpus, "\n", 1);
+  }
+  free(stack);
+  if (success)
+    add_defect(corpus, options->defect);
+  return success;
+}
+
+/* Breaks the first tag after the middle of the corpus */
+void add_defect(input_buffer *corpus, defect defect) {
+  if (defect == DEFECT_NONE) return;
+  char *s = corpus->content + corpus->size / 2, *end = corpus->content + corpus->size;
+  bool is_close_needed = defect == DEFECT_UNCLOSED || defect == DEFECT_MISMATCH;
+  while (s + 1 < end && !(s[0] == '<' && (s[1] == '/') == is_close_needed && s[1] != 'b'))
+    s++;
+  if (s + 1 >= end) return;
+  switch (defect) {
+    case DEFECT_UNCLOSED:
+      // Close tag turns into text
+      s[1] = ' ';
+      break;
+    case DEFECT_STRAY_CLOSE:
+      // Open tag turns into text
+      s[0] = ' ';
+      break;
+    case DEFECT_MISMATCH:
+      // Close tag gets another name
+      s[2] = s[2] == 'x' ? 'y' : 'x';
+      break;
+    case DEFECT_BROKEN_TAG:
+      // Open tag is split by a newline, so it is text
+      s[1] = '\n';
+      break;
+    default:
+      break;
+  }
+}
+
+/* Rates are per MB of processed input, 0 for a run that isn't a pass over the input */
+void print_row(const corpus_options *options, size_t size, bool is_valid, const char *mode, const char *stage,
+               measure value, size_t processed) {
+  double megabytes = (double) processed / MEGABYTE;
+  printf("%s,%zu,%d,%s,%s,%.6f,%.2f,%zu,%.2f,%s\n", options->name, size, is_valid, mode, stage, value.seconds,
+         value.seconds > 0 ? megabytes / value.seconds : 0.0, value.allocations,
+         megabytes > 0 ? (double) value.allocations / megabytes : 0.0, BUILD_TYPE);
+}
+
+/*
+  Runs every mode over one corpus repeats times and prints the fastest runs. The single pass is split into
+  read, tokenize, format and write stages, other modes are measured as a whole. Returns false on failure
+ */
+bool bench_corpus(const corpus_options *options, const bench_options *bench) {
+  input_buffer corpus;
+  if (!generate_corpus(options, bench->size, bench->seed, &corpus)) return false;
+  FILE *file = tmpfile();
+  FILE *output_file = fopen(bench->output, "wb");
+  bool success = file != NULL && output_file != NULL
+      && fwrite(corpus.content, sizeof(char), corpus.size, file) == corpus.size && fflush(file) == 0;
+  size_t size = corpus.size;
+  free(corpus.content);
+
+  measure stages[4], modes[5];
+  const char *const stage_names[] = {"read", "tokenize", "format", "write"};
+  const char *const mode_names[] = {"div_format", "parallel", "stream", "document", "document"};
+  const char *const mode_stages[] = {"total", "total", "total", "build", "edit"};
+  for (size_t i = 0; i < 4; ++i)
+    stages[i] = (measure) {-1, 0};
+  for (size_t i = 0; i < 5; ++i)
+    modes[i] = (measure) {-1, 0};
+  bool is_valid = false;
+
+  for (size_t repeat = 0; success && repeat < bench->repeats; ++repeat) {
+    measure current[4] = {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+    input_buffer input = INPUT_BUFFER_INITIALIZER;
+    tag_table tags = TAG_TABLE_INITIALIZER;
+    tokens tokens = TOKENS_INITIALIZER;
+    tag_ids closes = TAG_IDS_INITIALIZER, opens = TAG_IDS_INITIALIZER;
+    writer formatted = {NULL}, output = {NULL};
+
+    rewind(file);
+    size_t allocations = get_allocations();
+    double start = get_time();
+    success = map_input(file, &input) || read_input(file, &input);
+    if (success && input.is_mapped)
+      touch_pages(&input);
+    current[0] = (measure) {get_time() - start, get_allocations() - allocations};
+
+    allocations = get_allocations();
+    start = get_time();
+    // Tokenizing stops at a wrong close tag, so a malformed corpus isn't a failure
+    is_valid = success && tokenize(&input, &tags, &tokens, &closes, &opens) && closes.size == 0 && opens.size == 0;
+    current[1] = (measure) {get_time() - start, get_allocations() - allocations};
+
+    if (is_valid) {
+      allocations = get_allocations();
+      start = get_time();
+      success = writer_init(&formatted, NULL);
+      if (success) {
+        write_tokens(&tokens, 0, &formatted);
+        success = !formatted.is_error;
+      }
+      current[2] = (measure) {get_time() - start, get_allocations() - allocations};
+
+      allocations = get_allocations();
+      start = get_time();
+      success = success && writer_init(&output, output_file);
+      if (success) {
+        writer_write(&output, formatted.buffer, formatted.size);
+        success = writer_flush(&output);
+      }
+      current[3] = (measure) {get_time() - start, get_allocations() - allocations};
+    }
+    for (size_t i = 0; i < 4; ++i)
+      if (stages[i].seconds < 0 || current[i].seconds < stages[i].seconds)
+        stages[i] = current[i];
+    writer_free(&formatted);
+    writer_free(&output);
+    free_tag_ids(&closes);
+    free_tag_ids(&opens);
+    free_tokens(&tokens);
+    free_tag_table(&tags);
+
+    // Whole modes, each writes through its own writer to the output
+    for (size_t mode = 0; success && mode < 5; ++mode) {
+      writer sink;
+      div_document document;
+      success = writer_init(&sink, output_file);
+      if (mode == 2) rewind(file);
+      allocations = get_allocations();
+      start = get_time();
+      bool result = false;
+      switch (mode) {
+        case 0:
+          result = div_format(&input, &sink);
+          break;
+        case 1:
+          result = div_format_parallel(&input, bench->threads_count, &sink);
+          break;
+        case 2:
+          result = div_format_stream(file, &sink);
+          break;
+        default:
+          result = div_document_build(&document, input.content, input.size, DEFAULT_CHECKPOINT_INTERVAL);
+          break;
+      }
+      measure value = {get_time() - start, get_allocations() - allocations};
+      if (mode == 4 && result) {
+        // Inserts and removes a space at line starts, so the document stays the same
+        unsigned long long state = bench->seed;
+        allocations = get_allocations();
+        start = get_time();
+        for (size_t i = 0; result && i < EDITS_COUNT; ++i) {
+          size_t offset = document.size == 0 ? 0 : next_random(&state) % document.size;
+          while (offset > 0 && input.content[offset - 1] != '\n')
+            offset--;
+          result = div_document_edit(&document, offset, 0, " ", 1) && div_document_edit(&document, offset, 1, NULL, 0);
+        }
+        // Latency and allocations of one edit, it re-formats only a few segments of the document
+        value.seconds = (get_time() - start) / (2 * EDITS_COUNT);
+        value.allocations = (get_allocations() - allocations) / (2 * EDITS_COUNT);
+      }
+      if (mode >= 3 && result)
+        result = div_document_write(&document, &sink);
+      if (mode >= 3)
+        div_document_free(&document);
+      // Result is false for malformed corpora, which are measured too
+      if (result != is_valid)
+        fprintf(stderr, "%s %s disagrees on %s corpus\n", mode_names[mode], mode_stages[mode], options->name);
+      success = success && !sink.is_error;
+      writer_flush(&sink);
+      writer_free(&sink);
+      if (modes[mode].seconds < 0 || value.seconds < modes[mode].seconds)
+        modes[mode] = value;
+    }
+    free_input(&input);
+  }
+
+  for (size_t i = 0; success && i < 4; ++i)
+    if (i < 2 || is_valid)
+      print_row(options, size, is_valid, "single", stage_names[i], stages[i], size);
+  for (size_t i = 0; success && i < 5; ++i)
+    print_row(options, size, is_valid, mode_names[i], mode_stages[i], modes[i], i == 4 ? 0 : size);
+  if (!success)
+    fprintf(stderr, "Benchmark of %s corpus failed\n", options->name);
+  if (file != NULL)
+    fclose(file);
+  if (output_file != NULL)
+    fclose(output_file);
+  return success;
+}
@@ -0,0 +1,1254 @@
+/*
+  Кобзев Антон АПО-11
+
+  Задача №1
+  Форматирование отступов разметки, см. divfmt.h
+ */
+
+#include "divfmt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#include <pthread.h>
+#define HAVE_THREADS
+#endif
+
+// Scanning helpers use the widest vectors enabled at compile time, e.g. -mavx2
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH 32
+#define SIMD_FULL_MASK 0xFFFFFFFFu
+typedef __m256i simd_vector;
+#define simd_load(p) _mm256_loadu_si256((const __m256i *) (p))
+#define simd_set(c) _mm256_set1_epi8(c)
+#define simd_equal(a, b) _mm256_cmpeq_epi8(a, b)
+#define simd_or(a, b) _mm256_or_si256(a, b)
+#define simd_subtract(a, b) _mm256_sub_epi8(a, b)
+#define simd_max(a, b) _mm256_max_epu8(a, b)
+#define simd_mask(a) ((unsigned) _mm256_movemask_epi8(a))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 16
+#define SIMD_FULL_MASK 0xFFFFu
+typedef __m128i simd_vector;
+#define simd_load(p) _mm_loadu_si128((const __m128i *) (p))
+#define simd_set(c) _mm_set1_epi8(c)
+#define simd_equal(a, b) _mm_cmpeq_epi8(a, b)
+#define simd_or(a, b) _mm_or_si128(a, b)
+#define simd_subtract(a, b) _mm_sub_epi8(a, b)
+#define simd_max(a, b) _mm_max_epu8(a, b)
+#define simd_mask(a) ((unsigned) _mm_movemask_epi8(a))
+#endif
+
+#define TAB_SIZE 4
+
+#define START_STRING_SIZE 100
+
+#define INPUT_BLOCK_SIZE 65536
+
+#define START_TOKENS_COUNT 100
+
+#define START_TAGS_COUNT 16
+
+#define START_SEGMENTS_COUNT 16
+
+#define WRITER_BUFFER_SIZE 65536
+
+#define STREAM_CHUNK_SIZE 65536
+
+// Longer names are not tags, so the stream keeps only a bounded part of a tag crossing chunks
+#define MAX_TAG_NAME_LENGTH 1024
+
+/* Classes of chars told apart by the tag lexer */
+typedef enum {
+  CHAR_OTHER, CHAR_LETTER, CHAR_NAME, CHAR_SPACE, CHAR_NEWLINE, CHAR_LESS, CHAR_GREATER, CHAR_SLASH, CHAR_QUOTE,
+  CHAR_APOSTROPHE, CHAR_CLASSES_COUNT
+} char_class;
+
+/* Tag lexer states, states from LEX_OPEN_TAG on are final */
+typedef enum {
+  LEX_TAG_START, LEX_OPEN_NAME, LEX_ATTRIBUTES, LEX_QUOTED, LEX_APOSTROPHED, LEX_SLASH, LEX_CLOSE_START,
+  LEX_CLOSE_NAME, LEX_CLOSE_END, LEX_OPEN_TAG, LEX_EMPTY_TAG, LEX_CLOSE_TAG, LEX_NOT_TAG
+} lex_state;
+
+struct tag_name {
+  char *name;  // Own copy, not null-terminated
+  size_t length;
+  size_t hash;
+};
+
+static bool insert_token(tokens *arr, token value);
+static bool intern_tag(tag_table *table, const char *name, size_t length, size_t *id);
+static bool push_tag_id(tag_ids *arr, size_t id);
+
+static const char *find_token_end(const char *s, const char *end);
+static const char *skip_spaces(const char *s, const char *end);
+static const char *skip_spaces_back(const char *begin, const char *s);
+static lex_state lex_run(lex_state state, const char **s, const char *end, size_t *name_length);
+static lex_state lex_tag(const char *s, const char *end, size_t *length, size_t *name_length);
+static size_t get_next_token(const char *s, const char *end, tag_table *tags, token *token);
+static bool match_tag(const token *token, tag_ids *closes, tag_ids *opens);
+static bool tokenize_range(const char *s, const char *end, tag_table *tags, tokens *tokens, tag_ids *closes,
+                           tag_ids *opens);
+
+/* Part of input formatted by its own thread, split right after a newline */
+typedef struct {
+  const char *begin;
+  const char *end;
+  tag_table tags;
+  tokens tokens;
+  tag_ids closes;  // Close tags matching open tags of previous chunks
+  tag_ids opens;  // Open tags left for next chunks
+  size_t depth;
+  writer output;
+  bool is_success;
+} div_chunk;
+
+static void *tokenize_chunk(void *data);
+static void *format_chunk(void *data);
+static bool join_chunk(div_chunk *chunk, tag_table *tags, tag_ids *stack);
+static bool run_chunks(div_chunk *chunks, size_t chunks_count, void *(*function)(void *));
+
+/* Open tag in a tree of open tag stacks, node 0 is the empty stack. Equal stacks are the same node */
+struct tag_node {
+  unsigned tag;
+  size_t parent;
+  size_t depth;
+};
+
+/* Part of a document between two checkpoints, it starts at a line start */
+struct div_segment {
+  char *input;
+  size_t input_size;
+  char *output;  // NULL if the segment has errors
+  size_t output_size;
+  size_t errors;  // Wrong close tags
+  size_t end_state;  // Node of the open tags stack after the segment
+};
+
+static bool push_tag_node(div_document *document, unsigned tag, size_t parent, size_t *node);
+static bool format_segment(div_document *document, div_segment *segment, size_t state);
+static bool split_segments(div_document *document, const char *s, size_t size, size_t state, div_segment **segments,
+                           size_t *segments_size);
+static void free_segment(div_segment *segment);
+static void copy_segments(const div_document *document, size_t first, size_t first_offset, size_t begin, size_t end,
+                          char *s);
+
+typedef enum { STREAM_TOKEN_START, STREAM_TAG, STREAM_TEXT } stream_state;
+
+/*
+  Formatter state carried between chunks, output == NULL only validates. Chars of earlier chunks that still
+  have to be printed are kept as input offsets and read again from source, the seekable input fed from
+  source_start on, so memory doesn't grow with runs of whitespace or long tags
+ */
+typedef struct {
+  writer *output;
+  FILE *source;
+  long source_start;
+  char *buffer;  // STREAM_CHUNK_SIZE chars read again, allocated on first use
+  const char *chunk;  // Chunk being fed
+  size_t chunk_offset;  // Input offset of chunk
+  stream_state state;
+  tag_table tags;
+  tag_ids opens;  // Depth is opens.size
+  bool is_text_printed;
+  bool is_error;
+  // Whitespace at the end of the text so far, printed only if more text follows
+  size_t spaces_offset;
+  size_t spaces_size;
+  // Tag crossing the chunk end, lexing continues in the next chunk
+  lex_state tag_state;
+  size_t tag_offset;
+  size_t tag_size;
+  size_t tag_text_size;  // Up to its last non-space char, in case it turns out to be text
+  size_t tag_name_length;
+  char tag[MAX_TAG_NAME_LENGTH + 2];  // Only "</" and the name are kept
+} div_stream;
+
+#define DIV_STREAM_INITIALIZER(output, source, source_start) \
+  {output, source, source_start, NULL, NULL, 0, STREAM_TOKEN_START, TAG_TABLE_INITIALIZER, TAG_IDS_INITIALIZER, \
+   false, false, 0, 0, LEX_TAG_START, 0, 0, 0, 0, {0}}
+
+static void div_stream_feed(div_stream *stream, const char *chunk, size_t size);
+static bool div_stream_finish(div_stream *stream);
+static void div_stream_print(div_stream *stream, const char *s, size_t size);
+static void div_stream_print_input(div_stream *stream, size_t offset, size_t size);
+static bool div_stream_reread(div_stream *stream, size_t offset, size_t size);
+static void div_stream_print_text(div_stream *stream, const char *s, size_t size, bool is_text_end);
+static void div_stream_end_text(div_stream *stream);
+static void div_stream_add_tag(div_stream *stream, const char *s, const char *end);
+static void div_stream_end_tag(div_stream *stream, lex_state state, const char *tag);
+static void div_stream_free(div_stream *stream);
+
+/* Maps the whole file if it is a regular file read from the start, returns true on success */
+bool map_input(FILE *file, input_buffer *input) {
+  if (file == NULL || input == NULL) return false;
+#ifdef HAVE_MMAP
+  int descriptor = fileno(file);
+  struct stat file_stat;
+  if (descriptor < 0 || fstat(descriptor, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) return false;
+  if (ftell(file) != 0 || lseek(descriptor, 0, SEEK_CUR) != 0) return false;
+  if (file_stat.st_size == 0) {
+    *input = (input_buffer) INPUT_BUFFER_INITIALIZER;
+    return true;
+  }
+  void *content = mmap(NULL, (size_t) file_stat.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  if (content == MAP_FAILED) return false;
+  madvise(content, (size_t) file_stat.st_size, MADV_SEQUENTIAL);
+  input->content = content;
+  input->size = input->capacity = (size_t) file_stat.st_size;
+  input->is_mapped = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+/* Reads the whole file in blocks into one buffer, returns true on success */
+bool read_input(FILE *file, input_buffer *input) {
+  if (file == NULL || input == NULL) return false;
+  do {
+    if (input->size == input->capacity) {
+      size_t new_capacity = input->capacity == 0 ? INPUT_BLOCK_SIZE : input->capacity * 2;
+      char *new_content = realloc(input->content, new_capacity * sizeof(char));
+      if (new_content == NULL) return false;
+      input->content = new_content;
+      input->capacity = new_capacity;
+    }
+    input->size += fread(input->content + input->size, sizeof(char), input->capacity - input->size, file);
+  } while (!feof(file) && !ferror(file));
+  return !ferror(file);
+}
+
+void free_input(input_buffer *input) {
+  if (input == NULL || input->content == NULL) return;
+#ifdef HAVE_MMAP
+  if (input->is_mapped)
+    munmap(input->content, input->capacity);
+  else
+#endif
+    free(input->content);
+  *input = (input_buffer) INPUT_BUFFER_INITIALIZER;
+}
+
+/* Returns true on success */
+bool writer_init(writer *writer, FILE *output) {
+  if (writer == NULL) return false;
+  writer->output = output;
+  writer->buffer = malloc(WRITER_BUFFER_SIZE * sizeof(char));
+  writer->size = 0;
+  writer->capacity = WRITER_BUFFER_SIZE;
+  writer->is_error = writer->buffer == NULL;
+  return !writer->is_error;
+}
+
+void writer_write(writer *writer, const char *s, size_t size) {
+  if (writer->is_error) return;
+  if (writer->size + size > writer->capacity) {
+    if (writer->output == NULL) {
+      size_t new_capacity = writer->capacity * 2;
+      while (new_capacity < writer->size + size)
+        new_capacity *= 2;
+      char *new_buffer = realloc(writer->buffer, new_capacity * sizeof(char));
+      if (new_buffer == NULL) {
+        writer->is_error = true;
+        return;
+      }
+      writer->buffer = new_buffer;
+      writer->capacity = new_capacity;
+    } else if (!writer_flush(writer)) {
+      return;
+    }
+  }
+  if (writer->output != NULL && size >= writer->capacity) {
+    if (fwrite(s, sizeof(char), size, writer->output) != size)
+      writer->is_error = true;
+    return;
+  }
+  memcpy(writer->buffer + writer->size, s, size);
+  writer->size += size;
+}
+
+void writer_write_indent(writer *writer, size_t indent) {
+  static const char spaces[] = "                                                                "
+                               "                                                                ";
+  while (indent > 0) {
+    size_t part = indent < sizeof(spaces) - 1 ? indent : sizeof(spaces) - 1;
+    writer_write(writer, spaces, part);
+    indent -= part;
+  }
+}
+
+/* Returns true on success */
+bool writer_flush(writer *writer) {
+  if (writer->is_error) return false;
+  if (writer->output == NULL) return true;
+  if (writer->size != 0 && fwrite(writer->buffer, sizeof(char), writer->size, writer->output) != writer->size)
+    writer->is_error = true;
+  writer->size = 0;
+  return !writer->is_error && fflush(writer->output) == 0;
+}
+
+void writer_free(writer *writer) {
+  if (writer == NULL) return;
+  free(writer->buffer);
+  writer->buffer = NULL;
+  writer->size = writer->capacity = 0;
+}
+
+/* Returns true on success */
+static bool insert_token(tokens *arr, token value) {
+  if (arr == NULL) return false;
+  if (arr->tokens == NULL) arr->size = arr->capacity = 0;
+  if (arr->size + 1 >= arr->capacity) {
+    size_t new_capacity = arr->capacity == 0 ? START_TOKENS_COUNT : arr->capacity * 2;
+    token *new_tokens = realloc(arr->tokens, sizeof(token) * new_capacity);
+    if (new_tokens == NULL) return false;
+    arr->tokens = new_tokens;
+    arr->capacity = new_capacity;
+  }
+  arr->tokens[arr->size++] = value;
+  return true;
+}
+
+void free_tokens(tokens *arr) {
+  if (arr == NULL) return;
+  free(arr->tokens);
+  arr->tokens = NULL;
+  arr->size = arr->capacity = 0;
+}
+
+/* FNV-1a */
+static inline size_t hash_tag_name(const char *name, size_t length) {
+  size_t hash = 2166136261u;
+  for (size_t i = 0; i < length; ++i)
+    hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+  return hash;
+}
+
+/*
+  Open addressing index over entries of a table, used by tag names and tag nodes. Slots hold entry + 1, 0 for an
+  empty slot. slots_count is a power of two at least twice the entries count, so probing always reaches an empty slot
+ */
+typedef bool (*is_entry_function)(const void *table, size_t entry, const void *key);
+typedef size_t (*hash_entry_function)(const void *table, size_t entry);
+
+/* Finds entry matching key with hash, returns true if there is one */
+static bool find_slot_entry(const size_t *slots, size_t slots_count, size_t hash, is_entry_function is_entry,
+                            const void *table, const void *key, size_t *entry) {
+  for (size_t slot = hash; slots_count != 0 && slots[slot &= slots_count - 1] != 0; ++slot) {
+    if (is_entry(table, slots[slot] - 1, key)) {
+      *entry = slots[slot] - 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void insert_slot_entry(size_t *slots, size_t slots_count, size_t hash, size_t entry) {
+  size_t slot = hash & (slots_count - 1);
+  while (slots[slot] != 0)
+    slot = (slot + 1) & (slots_count - 1);
+  slots[slot] = entry + 1;
+}
+
+/* Replaces slots with new_slots_count ones indexing entries [first, size), returns true on success */
+static bool rehash_slots(size_t **slots, size_t *slots_count, size_t new_slots_count, hash_entry_function hash_entry,
+                         const void *table, size_t first, size_t size) {
+  size_t *new_slots = calloc(new_slots_count, sizeof(size_t));
+  if (new_slots == NULL) return false;
+  free(*slots);
+  *slots = new_slots;
+  *slots_count = new_slots_count;
+  for (size_t i = first; i < size; ++i)
+    insert_slot_entry(new_slots, new_slots_count, hash_entry(table, i), i);
+  return true;
+}
+
+static bool is_tag_name(const void *table, size_t entry, const void *key) {
+  const tag_name *tag = &((const tag_table *) table)->names[entry], *name = key;
+  return tag->hash == name->hash && tag->length == name->length && memcmp(tag->name, name->name, name->length) == 0;
+}
+
+static size_t hash_tag_entry(const void *table, size_t entry) { return ((const tag_table *) table)->names[entry].hash; }
+
+/* Finds id of name, adding it if it is new. Returns true on success */
+static bool intern_tag(tag_table *table, const char *name, size_t length, size_t *id) {
+  if (table == NULL || id == NULL) return false;
+  size_t hash = hash_tag_name(name, length);
+  const tag_name key = {(char *) name, length, hash};
+  if (find_slot_entry(table->slots, table->slots_count, hash, is_tag_name, table, &key, id)) return true;
+
+  if (table->size == table->capacity) {
+    size_t new_capacity = table->capacity == 0 ? START_TAGS_COUNT : table->capacity * 2;
+    tag_name *new_names = realloc(table->names, new_capacity * sizeof(tag_name));
+    if (new_names == NULL) return false;
+    table->names = new_names;
+    if (!rehash_slots(&table->slots, &table->slots_count, new_capacity * 2, hash_tag_entry, table, 0, table->size))
+      return false;
+    table->capacity = new_capacity;
+  }
+  char *copy = malloc(length == 0 ? 1 : length);
+  if (copy == NULL) return false;
+  memcpy(copy, name, length);
+  table->names[table->size] = (tag_name) {copy, length, hash};
+  insert_slot_entry(table->slots, table->slots_count, hash, table->size);
+  *id = table->size++;
+  return true;
+}
+
+void free_tag_table(tag_table *table) {
+  if (table == NULL) return;
+  for (size_t i = 0; i < table->size; ++i)
+    free(table->names[i].name);
+  free(table->names);
+  free(table->slots);
+  *table = (tag_table) TAG_TABLE_INITIALIZER;
+}
+
+/* Returns true on success */
+static bool push_tag_id(tag_ids *arr, size_t id) {
+  if (arr == NULL) return false;
+  if (arr->size == arr->capacity) {
+    size_t new_capacity = arr->capacity == 0 ? START_TAGS_COUNT : arr->capacity * 2;
+    size_t *new_ids = realloc(arr->ids, new_capacity * sizeof(size_t));
+    if (new_ids == NULL) return false;
+    arr->ids = new_ids;
+    arr->capacity = new_capacity;
+  }
+  arr->ids[arr->size++] = id;
+  return true;
+}
+
+void free_tag_ids(tag_ids *arr) {
+  if (arr == NULL) return;
+  free(arr->ids);
+  *arr = (tag_ids) TAG_IDS_INITIALIZER;
+}
+
+/* Spaces of the C locale: ' ' and '\t'..'\r'. Unlike isspace() it takes any char and doesn't depend on locale */
+static inline bool is_space(char c) { return c == ' ' || (unsigned char) (c - '\t') <= '\r' - '\t'; }
+
+#ifdef SIMD_WIDTH
+/* Returns mask of is_space() chars */
+static inline unsigned simd_space_mask(simd_vector chunk) {
+  simd_vector control = simd_subtract(chunk, simd_set('\t'));
+  return simd_mask(simd_or(simd_equal(chunk, simd_set(' ')),
+                           simd_equal(simd_max(control, simd_set('\r' - '\t')), simd_set('\r' - '\t'))));
+}
+#endif
+
+/* Returns first '<' or '\n' in [s, end) or end */
+static const char *find_token_end(const char *s, const char *end) {
+#ifdef SIMD_WIDTH
+  for (; end - s >= SIMD_WIDTH; s += SIMD_WIDTH) {
+    simd_vector chunk = simd_load(s);
+    unsigned mask = simd_mask(simd_or(simd_equal(chunk, simd_set('<')), simd_equal(chunk, simd_set('\n'))));
+    if (mask != 0)
+      return s + __builtin_ctz(mask);
+  }
+#endif
+  while (s < end && *s != '<' && *s != '\n')
+    s++;
+  return s;
+}
+
+/* Returns first non-space char in [s, end) or end */
+static const char *skip_spaces(const char *s, const char *end) {
+#ifdef SIMD_WIDTH
+  for (; end - s >= SIMD_WIDTH; s += SIMD_WIDTH) {
+    unsigned mask = ~simd_space_mask(simd_load(s)) & SIMD_FULL_MASK;
+    if (mask != 0)
+      return s + __builtin_ctz(mask);
+  }
+#endif
+  while (s < end && is_space(*s))
+    s++;
+  return s;
+}
+
+/* Returns pointer after the last non-space char in [begin, s) or begin */
+static const char *skip_spaces_back(const char *begin, const char *s) {
+#ifdef SIMD_WIDTH
+  for (; s - begin >= SIMD_WIDTH; s -= SIMD_WIDTH) {
+    unsigned mask = ~simd_space_mask(simd_load(s - SIMD_WIDTH)) & SIMD_FULL_MASK;
+    if (mask != 0)
+      return s - SIMD_WIDTH + (31 - __builtin_clz(mask)) + 1;
+  }
+#endif
+  while (s > begin && is_space(*(s - 1)))
+    s--;
+  return s;
+}
+
+static const unsigned char char_classes[256] = {
+  ['a' ... 'z'] = CHAR_LETTER, ['A' ... 'Z'] = CHAR_LETTER, ['0' ... '9'] = CHAR_NAME,
+  ['-'] = CHAR_NAME, ['_'] = CHAR_NAME, [':'] = CHAR_NAME, ['.'] = CHAR_NAME,
+  [' '] = CHAR_SPACE, ['\t'] = CHAR_SPACE, ['\v'] = CHAR_SPACE, ['\f'] = CHAR_SPACE, ['\r'] = CHAR_SPACE,
+  ['\n'] = CHAR_NEWLINE, ['<'] = CHAR_LESS, ['>'] = CHAR_GREATER, ['/'] = CHAR_SLASH,
+  ['"'] = CHAR_QUOTE, ['\''] = CHAR_APOSTROPHE
+};
+
+/*
+  Tags are <name attributes>, <name attributes/> and </name>. A tag never contains '<' or '\n', so whatever
+  is not a tag is text starting with '<'
+ */
+static const unsigned char lex_transitions[LEX_OPEN_TAG][CHAR_CLASSES_COUNT] = {
+  //                OTHER            LETTER           NAME             SPACE            NEWLINE
+  //                LESS             GREATER          SLASH            QUOTE            APOSTROPHE
+  [LEX_TAG_START] = {LEX_NOT_TAG, LEX_OPEN_NAME, LEX_NOT_TAG, LEX_NOT_TAG, LEX_NOT_TAG,
+                     LEX_NOT_TAG, LEX_NOT_TAG, LEX_CLOSE_START, LEX_NOT_TAG, LEX_NOT_TAG},
+  [LEX_OPEN_NAME] = {LEX_NOT_TAG, LEX_OPEN_NAME, LEX_OPEN_NAME, LEX_ATTRIBUTES, LEX_NOT_TAG,
+                     LEX_NOT_TAG, LEX_OPEN_TAG, LEX_SLASH, LEX_NOT_TAG, LEX_NOT_TAG},
+  [LEX_ATTRIBUTES] = {LEX_ATTRIBUTES, LEX_ATTRIBUTES, LEX_ATTRIBUTES, LEX_ATTRIBUTES, LEX_NOT_TAG,
+                      LEX_NOT_TAG, LEX_OPEN_TAG, LEX_SLASH, LEX_QUOTED, LEX_APOSTROPHED},
+  [LEX_QUOTED] = {LEX_QUOTED, LEX_QUOTED, LEX_QUOTED, LEX_QUOTED, LEX_NOT_TAG,
+                  LEX_NOT_TAG, LEX_QUOTED, LEX_QUOTED, LEX_ATTRIBUTES, LEX_QUOTED},
+  [LEX_APOSTROPHED] = {LEX_APOSTROPHED, LEX_APOSTROPHED, LEX_APOSTROPHED, LEX_APOSTROPHED, LEX_NOT_TAG,
+                       LEX_NOT_TAG, LEX_APOSTROPHED, LEX_APOSTROPHED, LEX_APOSTROPHED, LEX_ATTRIBUTES},
+  [LEX_SLASH] = {LEX_ATTRIBUTES, LEX_ATTRIBUTES, LEX_ATTRIBUTES, LEX_ATTRIBUTES, LEX_NOT_TAG,
+                 LEX_NOT_TAG, LEX_EMPTY_TAG, LEX_SLASH, LEX_QUOTED, LEX_APOSTROPHED},
+  [LEX_CLOSE_START] = {LEX_NOT_TAG, LEX_CLOSE_NAME, LEX_NOT_TAG, LEX_NOT_TAG, LEX_NOT_TAG,
+                       LEX_NOT_TAG, LEX_NOT_TAG, LEX_NOT_TAG, LEX_NOT_TAG, LEX_NOT_TAG},
+  [LEX_CLOSE_NAME] = {LEX_NOT_TAG, LEX_CLOSE_NAME, LEX_CLOSE_NAME, LEX_CLOSE_END, LEX_NOT_TAG,
+                      LEX_NOT_TAG, LEX_CLOSE_TAG, LEX_NOT_TAG, LEX_NOT_TAG, LEX_NOT_TAG},
+  [LEX_CLOSE_END] = {LEX_NOT_TAG, LEX_NOT_TAG, LEX_NOT_TAG, LEX_CLOSE_END, LEX_NOT_TAG,
+                     LEX_NOT_TAG, LEX_CLOSE_TAG, LEX_NOT_TAG, LEX_NOT_TAG, LEX_NOT_TAG}
+};
+
+static inline lex_state lex_next(lex_state state, char c) {
+  return lex_transitions[state][char_classes[(unsigned char) c]];
+}
+
+static inline bool is_lex_name(lex_state state) { return state == LEX_OPEN_NAME || state == LEX_CLOSE_NAME; }
+
+/*
+  Runs the tag lexer from state until a final state or end, moving *s past the consumed chars and adding name
+  chars to *name_length. The char that gave LEX_NOT_TAG is not consumed. A name longer than
+  MAX_TAG_NAME_LENGTH gives LEX_NOT_TAG too, its consumed chars are text. Returns the last state
+ */
+static lex_state lex_run(lex_state state, const char **s, const char *end, size_t *name_length) {
+  const char *p = *s;
+  size_t name = 0;
+  while (p < end && state < LEX_OPEN_TAG) {
+    state = lex_next(state, *p++);
+    name += is_lex_name(state);
+  }
+  if (state == LEX_NOT_TAG) p--;
+  *s = p;
+  *name_length += name;
+  return *name_length > MAX_TAG_NAME_LENGTH ? LEX_NOT_TAG : state;
+}
+
+/*
+  Lexes tag at '<' at s. Returns LEX_OPEN_TAG, LEX_EMPTY_TAG or LEX_CLOSE_TAG with tag length and its name
+  length, name starts right after "<" or "</". Returns LEX_NOT_TAG otherwise
+ */
+static lex_state lex_tag(const char *s, const char *end, size_t *length, size_t *name_length) {
+  const char *p = s + 1;
+  *name_length = 0;
+  lex_state state = lex_run(LEX_TAG_START, &p, end, name_length);
+  if (state < LEX_OPEN_TAG) return LEX_NOT_TAG;  // Input ended inside the tag
+  *length = p - s;
+  return state;
+}
+
+/* Returns found token length or 0 at the end or on error, token content is a view into [s, end) */
+static size_t get_next_token(const char *s, const char *end, tag_table *tags, token *const token) {
+  if (s == NULL || end == NULL || token == NULL) return 0;
+  const char *begin = s;
+  while (begin < end && *begin == '\n')
+    begin++;
+  const char *text_end = begin;
+  if (begin < end && *begin == '<') {
+    size_t length, name_length;
+    lex_state state = lex_tag(begin, end, &length, &name_length);
+    if (state != LEX_NOT_TAG) {
+      token->type = state == LEX_OPEN_TAG ? TOKEN_OPEN_TAG : state == LEX_CLOSE_TAG ? TOKEN_CLOSE_TAG : TOKEN_EMPTY_TAG;
+      token->content = begin;
+      token->length = length;
+      const char *name = begin + (state == LEX_CLOSE_TAG ? 2 : 1);
+      size_t id;
+      if (!intern_tag(tags, name, name_length, &id)) return 0;
+      token->tag = (unsigned) id;
+      return (begin - s) + length;
+    }
+    text_end++;  // Not a tag, '<' starts text
+  }
+  text_end = find_token_end(text_end, end);
+  size_t token_length = text_end - s;
+  // Trim spaces by index
+  begin = skip_spaces(begin, text_end);
+  text_end = skip_spaces_back(begin, text_end);
+  token->type = TOKEN_TEXT;
+  token->content = begin;
+  token->length = text_end - begin;
+  token->tag = 0;
+  return token_length;
+}
+
+/*
+  Matches close tag to open tags by tag id. Close tags of open tags before the tokens are added to closes,
+  open tags left unclosed are in opens. Returns false on a wrong close tag or allocation failure
+ */
+static bool match_tag(const token *token, tag_ids *closes, tag_ids *opens) {
+  if (token->type == TOKEN_OPEN_TAG)
+    return push_tag_id(opens, token->tag);
+  if (token->type != TOKEN_CLOSE_TAG)
+    return true;
+  if (opens->size == 0)
+    return push_tag_id(closes, token->tag);
+  return opens->ids[--opens->size] == token->tag;
+}
+
+/* Tags are matched while tokenizing unless closes and opens are NULL, returns true on success */
+static bool tokenize_range(const char *s, const char *end, tag_table *tags, tokens *tokens, tag_ids *closes,
+                           tag_ids *opens) {
+  if (tokens == NULL) return false;
+  token token;
+  while (s < end) {
+    size_t token_length = get_next_token(s, end, tags, &token);
+    if (token_length == 0 || (closes != NULL && !match_tag(&token, closes, opens)) || !insert_token(tokens, token))
+      return false;
+    s += token_length;
+  }
+  return true;
+}
+
+/* Returns true on success */
+bool tokenize(const input_buffer *input, tag_table *tags, tokens *tokens, tag_ids *closes, tag_ids *opens) {
+  if (input == NULL) return false;
+  return tokenize_range(input->content, input->content + input->size, tags, tokens, closes, opens);
+}
+
+/* Writes tokens starting at depth levels of nesting, tokens should be correct */
+void write_tokens(const tokens *tokens, size_t depth, writer *output) {
+  depth *= TAB_SIZE;
+  for (size_t i = 0; i < tokens->size; ++i) {
+    const token *token = &tokens->tokens[i];
+    if (token->type == TOKEN_CLOSE_TAG)
+      depth -= TAB_SIZE;
+
+    if (token->length != 0) {
+      writer_write_indent(output, depth);
+      writer_write(output, token->content, token->length);
+      writer_write(output, "\n", 1);
+    }
+
+    if (token->type == TOKEN_OPEN_TAG)
+      depth += TAB_SIZE;
+  }
+}
+
+/* Returns true on success */
+bool div_format(const input_buffer *input, writer *output) {
+  if (input == NULL || output == NULL) return false;
+  tag_table tags = TAG_TABLE_INITIALIZER;
+  tokens tokens = TOKENS_INITIALIZER;
+  tag_ids closes = TAG_IDS_INITIALIZER, opens = TAG_IDS_INITIALIZER;
+  // Nothing is written unless the whole input is correct
+  bool success = tokenize(input, &tags, &tokens, &closes, &opens) && closes.size == 0 && opens.size == 0;
+  if (success)
+    write_tokens(&tokens, 0, output);
+  free_tag_ids(&closes);
+  free_tag_ids(&opens);
+  free_tokens(&tokens);
+  free_tag_table(&tags);
+  return success && !output->is_error;
+}
+
+static void *tokenize_chunk(void *data) {
+  div_chunk *chunk = data;
+  chunk->is_success = tokenize_range(chunk->begin, chunk->end, &chunk->tags, &chunk->tokens, &chunk->closes,
+                                     &chunk->opens);
+  return NULL;
+}
+
+static void *format_chunk(void *data) {
+  div_chunk *chunk = data;
+  chunk->is_success = writer_init(&chunk->output, NULL);
+  if (chunk->is_success) {
+    write_tokens(&chunk->tokens, chunk->depth, &chunk->output);
+    chunk->is_success = !chunk->output.is_error;
+  }
+  free_tokens(&chunk->tokens);
+  return NULL;
+}
+
+/*
+  Matches close tags of chunk against stack of tags left open by previous chunks and pushes its own open tags.
+  Chunk ids are translated to ids of tags. Returns true on success
+ */
+static bool join_chunk(div_chunk *chunk, tag_table *tags, tag_ids *stack) {
+  size_t *ids = malloc(chunk->tags.size * sizeof(size_t));
+  bool success = ids != NULL || chunk->tags.size == 0;
+  for (size_t i = 0; success && i < chunk->tags.size; ++i)
+    success = intern_tag(tags, chunk->tags.names[i].name, chunk->tags.names[i].length, &ids[i]);
+  chunk->depth = stack->size;
+  for (size_t i = 0; success && i < chunk->closes.size; ++i)
+    success = stack->size != 0 && stack->ids[--stack->size] == ids[chunk->closes.ids[i]];
+  for (size_t i = 0; success && i < chunk->opens.size; ++i)
+    success = push_tag_id(stack, ids[chunk->opens.ids[i]]);
+  free(ids);
+  return success;
+}
+
+/* Runs function for every chunk on its own thread, returns true if all of them succeeded */
+static bool run_chunks(div_chunk *chunks, size_t chunks_count, void *(*function)(void *)) {
+#ifdef HAVE_THREADS
+  pthread_t threads[MAX_THREADS_COUNT];
+  size_t started_count = 0;
+  while (started_count < chunks_count
+      && pthread_create(&threads[started_count], NULL, function, &chunks[started_count]) == 0)
+    started_count++;
+  // Chunks that didn't get a thread run here
+  for (size_t i = started_count; i < chunks_count; ++i)
+    function(&chunks[i]);
+  for (size_t i = 0; i < started_count; ++i)
+    pthread_join(threads[i], NULL);
+#else
+  for (size_t i = 0; i < chunks_count; ++i)
+    function(&chunks[i]);
+#endif
+  bool success = true;
+  for (size_t i = 0; i < chunks_count; ++i)
+    success = success && chunks[i].is_success;
+  return success;
+}
+
+/*
+  Same output as div_format. Chunks are tokenized and matched in parallel, then their unmatched tags are joined
+  in order, which gives starting depths. Then chunks are formatted in parallel and written in order.
+  Returns true on success
+ */
+bool div_format_parallel(const input_buffer *input, size_t threads_count, writer *output) {
+  if (input == NULL || output == NULL || threads_count == 0) return false;
+  if (threads_count > MAX_THREADS_COUNT) threads_count = MAX_THREADS_COUNT;
+  div_chunk chunks[MAX_THREADS_COUNT];
+  size_t chunks_count = 0;
+  // Tokens never cross a newline, so tokenizing from a line start gives the same tokens
+  const char *begin = input->content, *end = input->content + input->size;
+  for (size_t i = 1; i <= threads_count && begin < end; ++i) {
+    const char *chunk_end = i == threads_count ? end : input->content + input->size / threads_count * i;
+    if (chunk_end < begin) chunk_end = begin;
+    chunk_end = chunk_end < end ? memchr(chunk_end, '\n', end - chunk_end) : NULL;
+    chunk_end = chunk_end == NULL ? end : chunk_end + 1;
+    chunks[chunks_count++] = (div_chunk) {begin, chunk_end, TAG_TABLE_INITIALIZER, TOKENS_INITIALIZER,
+                                          TAG_IDS_INITIALIZER, TAG_IDS_INITIALIZER, 0, {NULL}, false};
+    begin = chunk_end;
+  }
+
+  bool success = run_chunks(chunks, chunks_count, tokenize_chunk);
+  tag_table tags = TAG_TABLE_INITIALIZER;
+  tag_ids stack = TAG_IDS_INITIALIZER;
+  for (size_t i = 0; success && i < chunks_count; ++i)
+    success = join_chunk(&chunks[i], &tags, &stack);
+  success = success && stack.size == 0;
+  free_tag_ids(&stack);
+  free_tag_table(&tags);
+  for (size_t i = 0; i < chunks_count; ++i) {
+    free_tag_ids(&chunks[i].closes);
+    free_tag_ids(&chunks[i].opens);
+    free_tag_table(&chunks[i].tags);
+  }
+
+  if (success) {
+    success = run_chunks(chunks, chunks_count, format_chunk);
+    for (size_t i = 0; success && i < chunks_count; ++i)
+      writer_write(output, chunks[i].output.buffer, chunks[i].output.size);
+    for (size_t i = 0; i < chunks_count; ++i)
+      writer_free(&chunks[i].output);
+  } else {
+    for (size_t i = 0; i < chunks_count; ++i)
+      free_tokens(&chunks[i].tokens);
+  }
+  return success && !output->is_error;
+}
+
+/* FNV-1a over tag id and parent node */
+static inline size_t hash_tag_node(unsigned tag, size_t parent) {
+  return (((2166136261u ^ tag) * 16777619u) ^ parent) * 16777619u;
+}
+
+static bool is_tag_node(const void *document, size_t entry, const void *key) {
+  const tag_node *node = &((const div_document *) document)->nodes[entry], *pushed = key;
+  return node->tag == pushed->tag && node->parent == pushed->parent;
+}
+
+static size_t hash_node_entry(const void *document, size_t entry) {
+  const tag_node *node = &((const div_document *) document)->nodes[entry];
+  return hash_tag_node(node->tag, node->parent);
+}
+
+/* Finds node of tag opened on top of parent, adding it if it is new. Returns true on success */
+static bool push_tag_node(div_document *document, unsigned tag, size_t parent, size_t *node) {
+  size_t hash = hash_tag_node(tag, parent);
+  const tag_node key = {tag, parent, document->nodes[parent].depth + 1};
+  if (find_slot_entry(document->node_slots, document->node_slots_count, hash, is_tag_node, document, &key, node))
+    return true;
+
+  if (document->nodes_size == document->nodes_capacity) {
+    size_t new_capacity = document->nodes_capacity * 2;
+    tag_node *new_nodes = realloc(document->nodes, new_capacity * sizeof(tag_node));
+    if (new_nodes == NULL) return false;
+    document->nodes = new_nodes;
+    // The root is never looked up, so it is not indexed
+    if (!rehash_slots(&document->node_slots, &document->node_slots_count, new_capacity * 2, hash_node_entry,
+                      document, 1, document->nodes_size))
+      return false;
+    document->nodes_capacity = new_capacity;
+  }
+  document->nodes[document->nodes_size] = key;
+  insert_slot_entry(document->node_slots, document->node_slots_count, hash, document->nodes_size);
+  *node = document->nodes_size++;
+  return true;
+}
+
+/*
+  Formats segment starting with state stack of open tags. A wrong close tag counts as an error but still closes
+  the last open tag, so states after an error match the ones of a full pass. Returns false on allocation failure
+ */
+static bool format_segment(div_document *document, div_segment *segment, size_t state) {
+  free(segment->output);
+  segment->output = NULL;
+  segment->output_size = 0;
+  document->errors -= segment->errors;
+  segment->errors = 0;
+
+  tokens tokens = TOKENS_INITIALIZER;
+  bool success = tokenize_range(segment->input, segment->input + segment->input_size, &document->tags, &tokens,
+                                NULL, NULL);
+  size_t node = state;
+  for (size_t i = 0; success && i < tokens.size; ++i) {
+    const token *token = &tokens.tokens[i];
+    if (token->type == TOKEN_OPEN_TAG) {
+      success = push_tag_node(document, token->tag, node, &node);
+    } else if (token->type == TOKEN_CLOSE_TAG) {
+      if (node == 0 || document->nodes[node].tag != token->tag)
+        segment->errors++;
+      if (node != 0)
+        node = document->nodes[node].parent;
+    }
+  }
+  segment->end_state = node;
+  document->errors += segment->errors;
+
+  if (success && segment->errors == 0) {
+    writer output;
+    success = writer_init(&output, NULL);
+    if (success) {
+      write_tokens(&tokens, document->nodes[state].depth, &output);
+      success = !output.is_error;
+      char *buffer = realloc(output.buffer, output.size == 0 ? 1 : output.size);
+      segment->output = buffer != NULL ? buffer : output.buffer;
+      segment->output_size = output.size;
+    }
+  }
+  free_tokens(&tokens);
+  return success;
+}
+
+/*
+  Splits size chars of s into new formatted segments at the first line starts after every checkpoint interval,
+  the first segment starts with state. Returns true on success
+ */
+static bool split_segments(div_document *document, const char *s, size_t size, size_t state, div_segment **segments,
+                           size_t *segments_size) {
+  *segments = NULL;
+  *segments_size = 0;
+  size_t capacity = 0;
+  const char *end = s + size;
+  while (s < end) {
+    // Last segment takes the rest up to twice the interval, so that re-splitting doesn't leave small segments
+    size_t interval = document->checkpoint_interval;
+    const char *segment_end = (size_t) (end - s) / 2 >= interval ? s + interval : end;
+    segment_end = segment_end < end ? memchr(segment_end - 1, '\n', end - segment_end + 1) : NULL;
+    segment_end = segment_end == NULL ? end : segment_end + 1;
+
+    if (*segments_size == capacity) {
+      capacity = capacity == 0 ? START_SEGMENTS_COUNT : capacity * 2;
+      div_segment *new_segments = realloc(*segments, capacity * sizeof(div_segment));
+      if (new_segments == NULL) return false;
+      *segments = new_segments;
+    }
+    div_segment *segment = &(*segments)[(*segments_size)++];
+    *segment = (div_segment) {malloc(segment_end - s), segment_end - s, NULL, 0, 0, state};
+    if (segment->input == NULL) return false;
+    memcpy(segment->input, s, segment_end - s);
+    if (!format_segment(document, segment, state)) return false;
+    state = segment->end_state;
+    s = segment_end;
+  }
+  return true;
+}
+
+static void free_segment(div_segment *segment) {
+  free(segment->input);
+  free(segment->output);
+}
+
+/* Copies document chars [begin, end) into s, segment first starts at first_offset */
+static void copy_segments(const div_document *document, size_t first, size_t first_offset, size_t begin, size_t end,
+                          char *s) {
+  for (size_t i = first, position = first_offset; begin < end; position += document->segments[i++].input_size) {
+    const div_segment *segment = &document->segments[i];
+    if (begin >= position + segment->input_size) continue;
+    size_t part = (end < position + segment->input_size ? end : position + segment->input_size) - begin;
+    memcpy(s, segment->input + (begin - position), part);
+    s += part;
+    begin += part;
+  }
+}
+
+/* Formats content from scratch, checkpoint_interval is the least segment size. Returns true on success */
+bool div_document_build(div_document *document, const char *content, size_t size, size_t checkpoint_interval) {
+  if (document == NULL || checkpoint_interval == 0) return false;
+  *document = (div_document) DIV_DOCUMENT_INITIALIZER;
+  document->checkpoint_interval = checkpoint_interval;
+  document->nodes = malloc(START_TAGS_COUNT * sizeof(tag_node));
+  document->node_slots = calloc(START_TAGS_COUNT * 2, sizeof(size_t));
+  if (document->nodes == NULL || document->node_slots == NULL) {
+    div_document_free(document);
+    return false;
+  }
+  document->nodes[0] = (tag_node) {0, 0, 0};
+  document->nodes_size = 1;
+  document->nodes_capacity = START_TAGS_COUNT;
+  document->node_slots_count = START_TAGS_COUNT * 2;
+  return div_document_edit(document, 0, 0, content, size);
+}
+
+/*
+  Replaces removed chars at offset by length chars of text. Segments around the edit are split again and only
+  segments up to the one after which the open tags stack is the same as before are re-formatted.
+  Returns true on success
+ */
+bool div_document_edit(div_document *document, size_t offset, size_t removed, const char *text, size_t length) {
+  if (document == NULL || document->is_error || offset > document->size || removed > document->size - offset
+      || (text == NULL && length != 0))
+    return false;
+  // Segments [first, last) are replaced. Old checkpoints after the edit stay line starts, as the newline
+  // before each of them is kept
+  size_t first = 0, first_offset = 0;
+  while (first + 1 < document->segments_size && first_offset + document->segments[first].input_size <= offset)
+    first_offset += document->segments[first++].input_size;
+  size_t last = first, last_offset = first_offset;
+  while (last < document->segments_size && (last == first || last_offset <= offset + removed))
+    last_offset += document->segments[last++].input_size;
+  size_t state = first == 0 ? 0 : document->segments[first - 1].end_state;
+  size_t old_state = last == 0 ? 0 : document->segments[last - 1].end_state;
+
+  size_t size = last_offset - first_offset - removed + length;
+  char *content = malloc(size == 0 ? 1 : size);
+  div_segment *segments = NULL;
+  size_t segments_size = 0;
+  bool success = content != NULL;
+  if (success) {
+    copy_segments(document, first, first_offset, first_offset, offset, content);
+    if (length != 0)
+      memcpy(content + (offset - first_offset), text, length);
+    copy_segments(document, first, first_offset, offset + removed, last_offset,
+                  content + (offset - first_offset) + length);
+    success = split_segments(document, content, size, state, &segments, &segments_size);
+  }
+  free(content);
+
+  size_t new_size = document->segments_size - (last - first) + segments_size;
+  if (success && new_size > document->segments_capacity) {
+    size_t new_capacity = document->segments_capacity == 0 ? START_SEGMENTS_COUNT : document->segments_capacity;
+    while (new_capacity < new_size)
+      new_capacity *= 2;
+    div_segment *new_segments = realloc(document->segments, new_capacity * sizeof(div_segment));
+    success = new_segments != NULL;
+    if (success) {
+      document->segments = new_segments;
+      document->segments_capacity = new_capacity;
+    }
+  }
+  if (!success) {
+    for (size_t i = 0; i < segments_size; ++i) {
+      document->errors -= segments[i].errors;
+      free_segment(&segments[i]);
+    }
+    free(segments);
+    document->is_error = true;
+    return false;
+  }
+
+  for (size_t i = first; i < last; ++i) {
+    document->errors -= document->segments[i].errors;
+    free_segment(&document->segments[i]);
+  }
+  if (last < document->segments_size)
+    memmove(document->segments + first + segments_size, document->segments + last,
+            (document->segments_size - last) * sizeof(div_segment));
+  if (segments_size != 0)
+    memcpy(document->segments + first, segments, segments_size * sizeof(div_segment));
+  free(segments);
+  document->segments_size = new_size;
+  document->size = document->size - removed + length;
+
+  // Segments after the edit keep their input and are re-formatted only while the stack differs
+  if (segments_size != 0)
+    state = document->segments[first + segments_size - 1].end_state;
+  for (size_t i = first + segments_size; i < document->segments_size && state != old_state; ++i) {
+    old_state = document->segments[i].end_state;
+    if (!format_segment(document, &document->segments[i], state)) {
+      document->is_error = true;
+      return false;
+    }
+    state = document->segments[i].end_state;
+  }
+  return true;
+}
+
+/* Writes the formatted document, returns false if it is not correct */
+bool div_document_write(const div_document *document, writer *output) {
+  if (document == NULL || output == NULL || document->is_error || document->errors != 0) return false;
+  if (document->segments_size != 0 && document->segments[document->segments_size - 1].end_state != 0)
+    return false;
+  for (size_t i = 0; i < document->segments_size; ++i)
+    writer_write(output, document->segments[i].output, document->segments[i].output_size);
+  return !output->is_error;
+}
+
+void div_document_free(div_document *document) {
+  if (document == NULL) return;
+  for (size_t i = 0; i < document->segments_size; ++i)
+    free_segment(&document->segments[i]);
+  free(document->segments);
+  free_tag_table(&document->tags);
+  free(document->nodes);
+  free(document->node_slots);
+  *document = (div_document) DIV_DOCUMENT_INITIALIZER;
+}
+
+static void div_stream_print(div_stream *stream, const char *s, size_t size) {
+  if (stream->output == NULL) return;
+  writer_write(stream->output, s, size);
+  stream->is_error = stream->is_error || stream->output->is_error;
+}
+
+/* Prints size chars of input from offset on, chars before the current chunk are read again from source */
+static void div_stream_print_input(div_stream *stream, size_t offset, size_t size) {
+  if (stream->output == NULL || size == 0) return;
+  if (offset < stream->chunk_offset) {
+    size_t past_size = stream->chunk_offset - offset < size ? stream->chunk_offset - offset : size;
+    if (!div_stream_reread(stream, offset, past_size)) {
+      stream->is_error = true;
+      return;
+    }
+    offset += past_size;
+    size -= past_size;
+  }
+  if (size != 0)
+    div_stream_print(stream, stream->chunk + (offset - stream->chunk_offset), size);
+}
+
+/* Prints size chars of input from offset on read from source, keeps its position. Returns true on success */
+static bool div_stream_reread(div_stream *stream, size_t offset, size_t size) {
+  if (stream->source == NULL) return false;
+  if (stream->buffer == NULL && (stream->buffer = malloc(STREAM_CHUNK_SIZE * sizeof(char))) == NULL)
+    return false;
+  long position = ftell(stream->source);
+  if (position < 0 || fseek(stream->source, stream->source_start + (long) offset, SEEK_SET) != 0)
+    return false;
+  while (size > 0) {
+    size_t block_size = size < STREAM_CHUNK_SIZE ? size : STREAM_CHUNK_SIZE;
+    if (fread(stream->buffer, sizeof(char), block_size, stream->source) != block_size)
+      return false;
+    div_stream_print(stream, stream->buffer, block_size);
+    size -= block_size;
+  }
+  return fseek(stream->source, position, SEEK_SET) == 0;
+}
+
+/* Prints text of the current token, trailing whitespace is kept as an input range until more text follows */
+static void div_stream_print_text(div_stream *stream, const char *s, size_t size, bool is_text_end) {
+  if (stream->output == NULL) return;
+  const char *end = s + size;
+  if (!stream->is_text_printed) {
+    s = skip_spaces(s, end);
+    if (s == end) return;
+    writer_write_indent(stream->output, stream->opens.size * TAB_SIZE);
+    stream->is_text_printed = true;
+  }
+  const char *last = skip_spaces_back(s, end);
+  if (last > s) {
+    div_stream_print_input(stream, stream->spaces_offset, stream->spaces_size);
+    stream->spaces_size = 0;
+    div_stream_print(stream, s, last - s);
+  }
+  if (last == end || is_text_end) return;
+  if (stream->spaces_size == 0)
+    stream->spaces_offset = stream->chunk_offset + (last - stream->chunk);
+  stream->spaces_size += end - last;
+}
+
+static void div_stream_end_text(div_stream *stream) {
+  if (stream->is_text_printed)
+    div_stream_print(stream, "\n", 1);
+  stream->spaces_size = 0;
+  stream->is_text_printed = false;
+  stream->state = STREAM_TOKEN_START;
+}
+
+/* Adds chars [s, end) of the current chunk to the tag crossing chunks */
+static void div_stream_add_tag(div_stream *stream, const char *s, const char *end) {
+  size_t size = end - s;
+  // Names are capped, so "</" and the name always fit
+  if (stream->tag_size < sizeof(stream->tag)) {
+    size_t kept_size = sizeof(stream->tag) - stream->tag_size < size ? sizeof(stream->tag) - stream->tag_size : size;
+    memcpy(stream->tag + stream->tag_size, s, kept_size);
+  }
+  const char *last = skip_spaces_back(s, end);
+  if (last > s)
+    stream->tag_text_size = stream->tag_size + (last - s);
+  stream->tag_size += size;
+}
+
+/* Handles the tag of tag_size chars at tag_offset, state is the final lexer state, tag has at least its name */
+static void div_stream_end_tag(div_stream *stream, lex_state state, const char *tag) {
+  if (state == LEX_NOT_TAG) {
+    // Not a tag, its chars start text and its trailing whitespace waits for more text as usual
+    if (stream->output != NULL) {
+      writer_write_indent(stream->output, stream->opens.size * TAB_SIZE);
+      div_stream_print_input(stream, stream->tag_offset, stream->tag_text_size);
+      stream->is_text_printed = true;
+      stream->spaces_offset = stream->tag_offset + stream->tag_text_size;
+      stream->spaces_size = stream->tag_size - stream->tag_text_size;
+    }
+    stream->state = STREAM_TEXT;
+  } else {
+    size_t id;
+    const char *name = tag + (state == LEX_CLOSE_TAG ? 2 : 1);
+    if (!intern_tag(&stream->tags, name, stream->tag_name_length, &id)) {
+      stream->is_error = true;
+    } else if (state == LEX_CLOSE_TAG) {
+      if (stream->opens.size == 0 || stream->opens.ids[stream->opens.size - 1] != id)
+        stream->is_error = true;
+      else
+        stream->opens.size--;
+    }
+    if (stream->output != NULL) {
+      writer_write_indent(stream->output, stream->opens.size * TAB_SIZE);
+      div_stream_print_input(stream, stream->tag_offset, stream->tag_size);
+      div_stream_print(stream, "\n", 1);
+    }
+    stream->state = STREAM_TOKEN_START;
+    if (state == LEX_OPEN_TAG && !push_tag_id(&stream->opens, id))
+      stream->is_error = true;
+  }
+}
+
+/* Same tokens as get_next_token, but any token may span several chunks */
+static void div_stream_feed(div_stream *stream, const char *chunk, size_t size) {
+  const char *s = chunk, *end = chunk + size;
+  stream->chunk = chunk;
+  while (s < end && !stream->is_error) {
+    switch (stream->state) {
+      case STREAM_TOKEN_START:
+        if (*s == '\n') {
+          s++;
+        } else if (*s == '<') {
+          // Tags inside the chunk are handled in place, only the name of a tag crossing the chunk end is copied
+          const char *tag = s++;
+          stream->tag_offset = stream->chunk_offset + (tag - chunk);
+          stream->tag_name_length = 0;
+          stream->tag_state = lex_run(LEX_TAG_START, &s, end, &stream->tag_name_length);
+          if (stream->tag_state >= LEX_OPEN_TAG) {
+            stream->tag_size = s - tag;
+            if (stream->tag_state == LEX_NOT_TAG)
+              stream->tag_text_size = skip_spaces_back(tag, s) - tag;
+            div_stream_end_tag(stream, stream->tag_state, tag);
+          } else {
+            stream->tag_size = 0;
+            div_stream_add_tag(stream, tag, s);
+            stream->state = STREAM_TAG;
+          }
+        } else {
+          stream->state = STREAM_TEXT;
+        }
+        break;
+      case STREAM_TAG: {
+        const char *tag = s;
+        stream->tag_state = lex_run(stream->tag_state, &s, end, &stream->tag_name_length);
+        div_stream_add_tag(stream, tag, s);
+        if (stream->tag_state >= LEX_OPEN_TAG)
+          div_stream_end_tag(stream, stream->tag_state, stream->tag);
+        break;
+      }
+      case STREAM_TEXT: {
+        const char *text = s;
+        s = find_token_end(s, end);
+        div_stream_print_text(stream, text, s - text, s < end);
+        if (s < end)
+          div_stream_end_text(stream);
+        break;
+      }
+    }
+  }
+  stream->chunk_offset += size;
+}
+
+/* Returns true if the whole input was correct */
+static bool div_stream_finish(div_stream *stream) {
+  if (stream->state == STREAM_TAG)
+    div_stream_end_tag(stream, LEX_NOT_TAG, stream->tag);
+  div_stream_end_text(stream);
+  return !stream->is_error && stream->opens.size == 0;
+}
+
+static void div_stream_free(div_stream *stream) {
+  if (stream == NULL) return;
+  free_tag_table(&stream->tags);
+  free_tag_ids(&stream->opens);
+  free(stream->buffer);
+  *stream = (div_stream) DIV_STREAM_INITIALIZER(NULL, NULL, 0);
+}
+
+/*
+  Formats input chunk by chunk. Output is printed only after the first pass validated the whole input,
+  non-seekable input is copied to a temporary file on the way. Returns true on success
+ */
+bool div_format_stream(FILE *input, writer *output) {
+  if (input == NULL || output == NULL) return false;
+  char *chunk = malloc(STREAM_CHUNK_SIZE * sizeof(char));
+  if (chunk == NULL) return false;
+  long start = ftell(input);
+  FILE *copy = start < 0 || fseek(input, start, SEEK_SET) != 0 ? tmpfile() : NULL;
+  bool success = start >= 0 || copy != NULL;
+
+  div_stream stream = DIV_STREAM_INITIALIZER(NULL, NULL, 0);
+  size_t size;
+  while (success && !stream.is_error && (size = fread(chunk, sizeof(char), STREAM_CHUNK_SIZE, input)) > 0) {
+    div_stream_feed(&stream, chunk, size);
+    if (copy != NULL && fwrite(chunk, sizeof(char), size, copy) != size)
+      success = false;
+  }
+  success = success && !ferror(input) && div_stream_finish(&stream);
+  div_stream_free(&stream);
+
+  FILE *source = copy != NULL ? copy : input;
+  long source_start = copy != NULL ? 0 : start;
+  if (success)
+    success = fseek(source, source_start, SEEK_SET) == 0;
+  if (success) {
+    stream = (div_stream) DIV_STREAM_INITIALIZER(output, source, source_start);
+    while (!stream.is_error && (size = fread(chunk, sizeof(char), STREAM_CHUNK_SIZE, source)) > 0)
+      div_stream_feed(&stream, chunk, size);
+    success = !ferror(source) && div_stream_finish(&stream);
+  }
+
+  div_stream_free(&stream);
+  if (copy != NULL)
+    fclose(copy);
+  free(chunk);
+  return success;
+}
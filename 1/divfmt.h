@@ -0,0 +1,141 @@
+/*
+  divfmt: форматирование отступов разметки из вложенных тэгов
+
+  Помимо div_format есть потоковый, многопоточный и инкрементальный режимы. Этапы div_format (чтение, разбор на
+  токены, форматирование, запись) объявлены здесь же, чтобы их можно было измерять по отдельности.
+ */
+
+#ifndef DIVFMT_H
+#define DIVFMT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define MAX_THREADS_COUNT 256
+
+typedef enum { TOKEN_OPEN_TAG, TOKEN_CLOSE_TAG, TOKEN_EMPTY_TAG, TOKEN_TEXT } token_type;
+
+typedef struct {
+  token_type type;
+  const char *content;  // Points into input, not null-terminated
+  size_t length;
+  unsigned tag;  // Interned tag name id, unused for text. Keeps token 3 words long
+} token;
+
+typedef struct {
+  token *tokens;
+  size_t size;
+  size_t capacity;
+} tokens;
+
+#define TOKENS_INITIALIZER {NULL, 0, 0}
+
+typedef struct tag_name tag_name;
+
+/* Open addressing hash table of tag names, tag id is its index in names */
+typedef struct {
+  tag_name *names;
+  size_t size;
+  size_t capacity;
+  size_t *slots;  // Tag id + 1, 0 for an empty slot
+  size_t slots_count;  // Power of two, twice the capacity
+} tag_table;
+
+#define TAG_TABLE_INITIALIZER {NULL, 0, 0, NULL, 0}
+
+typedef struct {
+  size_t *ids;
+  size_t size;
+  size_t capacity;
+} tag_ids;
+
+#define TAG_IDS_INITIALIZER {NULL, 0, 0}
+
+/* Whole input in one buffer, either mapped or read in blocks */
+typedef struct {
+  char *content;
+  size_t size;
+  size_t capacity;
+  bool is_mapped;
+} input_buffer;
+
+#define INPUT_BUFFER_INITIALIZER {NULL, 0, 0, false}
+
+/* Collects output in one buffer and writes it in WRITER_BUFFER_SIZE blocks */
+typedef struct {
+  FILE *output;  // NULL keeps the whole output in buffer
+  char *buffer;
+  size_t size;
+  size_t capacity;
+  bool is_error;
+} writer;
+
+bool map_input(FILE *file, input_buffer *input);
+
+bool read_input(FILE *file, input_buffer *input);
+
+void free_input(input_buffer *input);
+
+bool writer_init(writer *writer, FILE *output);
+
+void writer_write(writer *writer, const char *s, size_t size);
+
+void writer_write_indent(writer *writer, size_t indent);
+
+bool writer_flush(writer *writer);
+
+void writer_free(writer *writer);
+
+void free_tokens(tokens *arr);
+
+void free_tag_table(tag_table *table);
+
+void free_tag_ids(tag_ids *arr);
+
+bool tokenize(const input_buffer *input, tag_table *tags, tokens *tokens, tag_ids *closes, tag_ids *opens);
+
+void write_tokens(const tokens *tokens, size_t depth, writer *output);
+
+bool div_format(const input_buffer *input, writer *output);
+
+bool div_format_parallel(const input_buffer *input, size_t threads_count, writer *output);
+
+bool div_format_stream(FILE *input, writer *output);
+
+typedef struct tag_node tag_node;
+
+typedef struct div_segment div_segment;
+
+/*
+  Formatted document split into segments at checkpoints every checkpoint_interval bytes or more. An edit is
+  re-formatted from the checkpoint before it until the open tags stack matches the old one again.
+  Nodes are looked up by parent and tag, so re-formatting reuses them and they grow only with distinct stacks
+ */
+typedef struct {
+  size_t checkpoint_interval;
+  size_t size;
+  div_segment *segments;
+  size_t segments_size;
+  size_t segments_capacity;
+  tag_table tags;
+  tag_node *nodes;
+  size_t nodes_size;
+  size_t nodes_capacity;
+  size_t *node_slots;  // Node + 1, 0 for an empty slot, the root is not there
+  size_t node_slots_count;  // Power of two, twice the nodes capacity
+  size_t errors;
+  bool is_error;  // Allocation failed, the document has to be built again
+} div_document;
+
+#define DIV_DOCUMENT_INITIALIZER {0, 0, NULL, 0, 0, TAG_TABLE_INITIALIZER, NULL, 0, 0, NULL, 0, 0, false}
+
+bool div_document_build(div_document *document, const char *content, size_t size, size_t checkpoint_interval);
+
+bool div_document_edit(div_document *document, size_t offset, size_t removed, const char *text, size_t length);
+
+bool div_document_write(const div_document *document, writer *output);
+
+void div_document_free(div_document *document);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+  Проверка инкрементального форматирования: случайные правки div_document сравниваются с div_format всего
+  отредактированного текста
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "divfmt.h"
+
+#define ROUNDS_COUNT 300
+#define EDITS_COUNT 60
+#define MAX_SNIPPETS_COUNT 200
+#define MAX_CHECKPOINT_INTERVAL 64
+#define MAX_EDIT_SIZE 64
+#define MAX_REMOVED_SIZE 12
+
+/* Balanced lines, the document stays correct while only they are inserted and removed at line starts */
+static const char *const snippets[] = {
+    "<div>\n  a  \n</div>\n", "<span x='>'>b</span>\n", "<p>\n<div>c</div>\n</p>\n", "text\n", "<br/>\n"
+};
+
+/* Pieces of arbitrary edits, they may break the document and fix it again */
+static const char *const pieces[] = {
+    "<div>", "</div>", "<span a=\"1\">", "</span>", "\n", "text", " x ", "<", "<br/>", "\n\n", "</div>\n", "<div>\n"
+};
+
+#define SNIPPETS_COUNT (sizeof(snippets) / sizeof(*snippets))
+#define PIECES_COUNT (sizeof(pieces) / sizeof(*pieces))
+
+typedef struct {
+  char *content;
+  size_t size;
+  size_t capacity;
+} text;
+
+unsigned long long next_random(unsigned long long *state);
+
+size_t random_below(unsigned long long *state, size_t bound);
+
+bool text_replace(text *text, size_t offset, size_t removed, const char *s, size_t length);
+
+bool check_document(const div_document *document, const text *text);
+
+bool run_round(unsigned long long *state, size_t round);
+
+int main() {
+  unsigned long long state = 88172645463325252ull;
+  size_t failures = 0;
+  for (size_t round = 0; round < ROUNDS_COUNT; ++round)
+    failures += !run_round(&state, round);
+  printf("%zu of %d rounds failed\n", failures, ROUNDS_COUNT);
+  return failures != 0;
+}
+
+/* xorshift64*, the same edits on every platform */
+unsigned long long next_random(unsigned long long *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ull;
+}
+
+size_t random_below(unsigned long long *state, size_t bound) {
+  return bound == 0 ? 0 : (size_t) (next_random(state) % bound);
+}
+
+/* Same edit as div_document_edit, returns true on success */
+bool text_replace(text *text, size_t offset, size_t removed, const char *s, size_t length) {
+  size_t size = text->size - removed + length;
+  if (size > text->capacity) {
+    size_t capacity = text->capacity * 2 > size ? text->capacity * 2 : size;
+    char *content = realloc(text->content, capacity);
+    if (content == NULL) return false;
+    text->content = content;
+    text->capacity = capacity;
+  }
+  memmove(text->content + offset + length, text->content + offset + removed, text->size - offset - removed);
+  memcpy(text->content + offset, s, length);
+  text->size = size;
+  return true;
+}
+
+/* Returns true if the document is written exactly as div_format writes the whole text */
+bool check_document(const div_document *document, const text *text) {
+  writer expected, actual;
+  if (!writer_init(&expected, NULL)) return false;
+  if (!writer_init(&actual, NULL)) {
+    writer_free(&expected);
+    return false;
+  }
+  input_buffer input = {text->content, text->size, text->size, false};
+  bool is_correct = div_format(&input, &expected);
+  bool is_same = document->size == text->size && div_document_write(document, &actual) == is_correct &&
+                 !expected.is_error && !actual.is_error;
+  if (is_same && is_correct)
+    is_same = actual.size == expected.size && memcmp(actual.buffer, expected.buffer, expected.size) == 0;
+  writer_free(&expected);
+  writer_free(&actual);
+  return is_same;
+}
+
+/* Builds a random document and checks it after every random edit, returns true if all checks passed */
+bool run_round(unsigned long long *state, size_t round) {
+  text text = {NULL, 0, 0};
+  size_t snippets_count = random_below(state, MAX_SNIPPETS_COUNT);
+  for (size_t i = 0; i < snippets_count; ++i) {
+    const char *snippet = snippets[random_below(state, SNIPPETS_COUNT)];
+    if (!text_replace(&text, text.size, 0, snippet, strlen(snippet))) {
+      free(text.content);
+      return false;
+    }
+  }
+  div_document document = DIV_DOCUMENT_INITIALIZER;
+  bool success = div_document_build(&document, text.content, text.size,
+                                    1 + random_below(state, MAX_CHECKPOINT_INTERVAL)) &&
+                 check_document(&document, &text);
+  for (size_t edit = 0; success && edit < EDITS_COUNT; ++edit) {
+    size_t offset = random_below(state, text.size + 1), removed = 0, length = 0;
+    char inserted[MAX_EDIT_SIZE];
+    if (random_below(state, 40) != 0) {
+      // Inserts or removes a balanced snippet at a line start
+      while (offset > 0 && text.content[offset - 1] != '\n')
+        offset--;
+      if (random_below(state, 2) == 0) {
+        const char *snippet = snippets[random_below(state, SNIPPETS_COUNT)];
+        length = strlen(snippet);
+        memcpy(inserted, snippet, length);
+      } else {
+        for (size_t i = 0; i < SNIPPETS_COUNT; ++i) {
+          size_t snippet_length = strlen(snippets[i]);
+          if (text.size - offset >= snippet_length && memcmp(text.content + offset, snippets[i], snippet_length) == 0)
+            removed = snippet_length;
+        }
+      }
+    } else {
+      removed = random_below(state, text.size - offset + 1) % MAX_REMOVED_SIZE;
+      for (size_t i = random_below(state, 3); i > 0; --i) {
+        const char *piece = pieces[random_below(state, PIECES_COUNT)];
+        memcpy(inserted + length, piece, strlen(piece));
+        length += strlen(piece);
+      }
+    }
+    success = div_document_edit(&document, offset, removed, inserted, length) &&
+              text_replace(&text, offset, removed, inserted, length) && check_document(&document, &text);
+    if (!success)
+      fprintf(stderr, "round %zu, edit %zu: %zu chars at %zu replaced by %zu\n", round, edit, removed, offset, length);
+  }
+  div_document_free(&document);
+  free(text.content);
+  return success;
+}
@@ -0,0 +1,799 @@
+/*
+  Кобзев Антон АПО-11
+
+  Задача №2
+  Длинная арифметика и парсер выражений, см. calc.h
+ */
+
+#include "calc.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#define max(a, b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a > _b ? _a : _b; })
+
+typedef struct {
+  char *content;
+  size_t size;
+  size_t capacity;
+} string;
+
+static void string_clear(string *string);
+static void string_add(string *string, char value);
+static void string_append(string *string, const char *other);
+
+#define NUMBER_PART_SIZE 9
+#define NUMBER_PART_FORMAT "%09d"
+#define NUMBER_BASE (int)1E9
+
+typedef struct {
+  int *parts;
+  size_t parts_size;
+  size_t parts_capacity;
+  bool is_negative;
+} number;
+
+// Extra numbers alive during one operation besides its operands (number_divide needs 5)
+#define NUMBER_POOL_TEMPORARIES 5
+
+/*
+  All numbers of an evaluation are taken from one slab in stack order: a number is freed together with
+  everything allocated after it, so each one gets exactly the parts it needs
+ */
+typedef struct {
+  number *numbers;
+  size_t numbers_size;
+  size_t numbers_capacity;
+  int *parts;
+  size_t parts_size;
+  size_t parts_capacity;
+} number_pool;
+
+static size_t number_pool_memory_size(size_t numbers_capacity, size_t parts_capacity);
+static void *number_pool_init(number_pool *pool, void *memory, size_t numbers_capacity, size_t parts_capacity);
+
+static number *number_new(number_pool *pool, size_t parts_capacity);
+static number *number_zero(number_pool *pool);
+static number *number_from_string(number_pool *pool, const char *literal, size_t literal_length,
+                                  size_t digits_count);
+static number *number_from_int(number_pool *pool, int value);
+static number *number_from_number(number_pool *pool, const number *source);
+static number *number_move(number_pool *pool, number *destination, const number *source);
+static void number_append_part(number *number, int part);
+static void number_remove_leading_zeroes(number *number);
+static void number_sprint(const number *number, string *destination);
+static void number_free(number_pool *pool, number *number);
+static bool is_number_zero(const number *number);
+static bool is_numbers_equal(const number *first, const number *second);
+static bool is_numbers_less(const number *first, const number *second);
+static bool is_numbers_abs_less(const number *first, const number *second);
+
+// Calculations can modify its params for performance purpose
+static number *number_add(number_pool *pool, number *first, number *second);
+static number *number_subtract(number_pool *pool, number *first, number *second);
+static number *number_multiply(number_pool *pool, number *first, number *second);
+// Returns NULL on division by zero
+static number *number_divide(number_pool *pool, number *first, number *second);
+
+// Stacks are views into preallocated memory and never grow
+typedef struct {
+  number **values;
+  size_t size;
+  size_t capacity;
+} number_stack;
+
+static void number_stack_push(number_stack *stack, number *number);
+static number *number_stack_top(const number_stack *stack);
+static number *number_stack_before_top(const number_stack *stack);
+static void number_stack_pop(number_stack *stack);
+
+typedef struct {
+  char *values;
+  size_t size;
+  size_t capacity;
+} char_stack;
+
+static void char_stack_push(char_stack *stack, char value);
+static char char_stack_top(const char_stack *stack);
+static void char_stack_pop(char_stack *stack);
+static bool is_char_stack_empty(const char_stack *stack);
+
+/*
+  The parser is shared by estimate_expression and evaluate_expression, which only differ in what an operand is.
+  It checks the syntax and counts operands itself, so handlers always get two operands to calculate
+ */
+typedef struct {
+  // literal spans from its unary minus or first digit to its last digit and may contain spaces
+  void (*push_number)(void *data, const char *literal, size_t literal_length, size_t digits_count);
+  calc_status (*calculate)(void *data, char operator);
+  void *data;
+} expression_handler;
+
+static calc_status parse_expression(const char *expression, size_t expression_size, char_stack *operators,
+                                    size_t *operators_count, const expression_handler *handler);
+static calc_status parse_literal_end(const char **literal, size_t *literal_length, size_t *digits_count,
+                                     size_t *operands_size, const expression_handler *handler);
+static calc_status parse_expression_on_stack_top(char_stack *operators, size_t *operands_size,
+                                                 const expression_handler *handler);
+static bool is_operator(char c);
+static size_t get_operator_precedence(char operator);
+
+// Upper bounds collected by estimate_expression before evaluation
+typedef struct {
+  size_t parts_count;
+  size_t operands_count;
+  size_t operators_count;
+  size_t result_length;
+} expression_estimate;
+
+/*
+  estimate_expression mirrors the operand stack with digits count bounds of the values on it and
+  parts_size with the parts they take from the pool
+ */
+typedef struct {
+  size_t *operands;
+  size_t operands_size;
+  size_t parts_size;
+  expression_estimate *estimate;
+} estimate_stack;
+
+static calc_status estimate_expression(const char *expression, size_t expression_size, char_stack *operators,
+                                       size_t *operands, expression_estimate *estimate);
+static void estimate_push_number(void *data, const char *literal, size_t literal_length, size_t digits_count);
+static calc_status estimate_expression_on_stack_top(void *data, char operator);
+static size_t estimate_calculate(size_t first_digits, size_t second_digits, char operator,
+                                 size_t *temporaries_parts);
+static size_t estimate_parts(size_t digits_count);
+
+// Everything evaluate_expression works with, carved from a single allocation
+typedef struct {
+  number_pool pool;
+  char_stack operators;
+  number_stack operands;
+  string result;
+} evaluation;
+
+static size_t evaluation_memory_size(const expression_estimate *estimate);
+static void evaluation_init(evaluation *evaluation, void *memory, const expression_estimate *estimate);
+static calc_status evaluate_expression(const char *expression, size_t expression_size, evaluation *evaluation);
+static void evaluate_push_number(void *data, const char *literal, size_t literal_length, size_t digits_count);
+static calc_status calculate_expression_on_stack_top(void *data, char operator);
+static number *calculate(number_pool *pool, number *first, number *second, char operator);
+
+static void *default_allocate(size_t size, void *data);
+static void default_deallocate(void *pointer, void *data);
+
+static const calc_allocator default_allocator = {default_allocate, default_deallocate, NULL};
+
+calc_status calc_evaluate(const char *expression, size_t expression_size, const calc_allocator *allocator,
+                          calc_sink sink, void *sink_data) {
+  if (expression == NULL || sink == NULL) return CALC_ERROR_SYNTAX;
+  if (allocator == NULL) allocator = &default_allocator;
+  if (expression_size == 0) return CALC_ERROR_SYNTAX;
+  if (expression_size > SIZE_MAX / (sizeof(size_t) + sizeof(char))) return CALC_ERROR_NO_MEMORY;
+
+  // There can't be more operands or operators than chars in expression
+  size_t *operands = allocator->allocate((sizeof(size_t) + sizeof(char)) * expression_size, allocator->data);
+  if (operands == NULL) return CALC_ERROR_NO_MEMORY;
+  char_stack operators = {(char *) (operands + expression_size), 0, expression_size};
+  expression_estimate estimate;
+  calc_status status = estimate_expression(expression, expression_size, &operators, operands, &estimate);
+  allocator->deallocate(operands, allocator->data);
+  if (status != CALC_OK) return status;
+
+  void *memory = allocator->allocate(evaluation_memory_size(&estimate), allocator->data);
+  if (memory == NULL) return CALC_ERROR_NO_MEMORY;
+  evaluation evaluation;
+  evaluation_init(&evaluation, memory, &estimate);
+  status = evaluate_expression(expression, expression_size, &evaluation);
+  if (status == CALC_OK && !sink(evaluation.result.content, evaluation.result.size, sink_data))
+    status = CALC_ERROR_SINK;
+  allocator->deallocate(memory, allocator->data);
+  return status;
+}
+
+static void number_stack_push(number_stack *stack, number *number) {
+  assert(stack != NULL && stack->size < stack->capacity);
+  stack->values[stack->size++] = number;
+}
+
+static number *number_stack_top(const number_stack *stack) {
+  assert(stack != NULL && stack->size > 0);
+  return stack->values[stack->size - 1];
+}
+
+static number *number_stack_before_top(const number_stack *stack) {
+  assert(stack != NULL && stack->size > 1);
+  return stack->values[stack->size - 2];
+}
+
+// The number stays in the pool, callers free it
+static void number_stack_pop(number_stack *stack) {
+  assert(stack != NULL && stack->size > 0);
+  --stack->size;
+}
+
+static void char_stack_push(char_stack *stack, char value) {
+  assert(stack != NULL && stack->size < stack->capacity);
+  stack->values[stack->size++] = value;
+}
+
+static char char_stack_top(const char_stack *stack) {
+  assert(stack != NULL && stack->size > 0);
+  return stack->values[stack->size - 1];
+}
+
+static void char_stack_pop(char_stack *stack) {
+  assert(stack != NULL && stack->size > 0);
+  --stack->size;
+}
+
+static bool is_char_stack_empty(const char_stack *stack) {
+  assert(stack != NULL);
+  return stack->size == 0;
+}
+
+static void string_clear(string *string) {
+  assert(string != NULL);
+  string->size = 0;
+  string->content[0] = '\0';
+}
+
+static void string_add(string *string, char value) {
+  assert(string != NULL && string->size + 1 < string->capacity);
+  string->content[string->size++] = value;
+  string->content[string->size] = '\0';
+}
+
+static void string_append(string *string, const char *other) {
+  assert(string != NULL && other != NULL);
+  size_t other_length = strlen(other);
+  assert(string->size + other_length < string->capacity);
+  memcpy(string->content + string->size, other, other_length);
+  string->size += other_length;
+  string->content[string->size] = '\0';
+}
+
+static size_t number_pool_memory_size(size_t numbers_capacity, size_t parts_capacity) {
+  return sizeof(number) * numbers_capacity + sizeof(int) * parts_capacity;
+}
+
+/* Returns memory right after the pool */
+static void *number_pool_init(number_pool *pool, void *memory, size_t numbers_capacity, size_t parts_capacity) {
+  assert(pool != NULL && memory != NULL);
+  // Layout: number headers, then all limbs
+  *pool = (number_pool) {memory, 0, numbers_capacity, (int *) ((number *) memory + numbers_capacity), 0,
+                         parts_capacity};
+  return pool->parts + parts_capacity;
+}
+
+static number *number_new(number_pool *pool, size_t parts_capacity) {
+  assert(pool != NULL && pool->numbers_size < pool->numbers_capacity
+             && parts_capacity <= pool->parts_capacity - pool->parts_size);
+  number *new_number = &pool->numbers[pool->numbers_size++];
+  new_number->parts = pool->parts + pool->parts_size;
+  new_number->parts_size = 0;
+  new_number->parts_capacity = parts_capacity;
+  new_number->is_negative = false;
+  pool->parts_size += parts_capacity;
+  return new_number;
+}
+
+static inline number *number_zero(number_pool *pool) {
+  return number_from_int(pool, 0);
+}
+
+static number *number_from_string(number_pool *pool, const char *literal, size_t literal_length,
+                                  size_t digits_count) {
+  assert(literal != NULL && literal_length > 0);
+  number *new_number = number_new(pool, estimate_parts(digits_count));
+  new_number->is_negative = literal[0] == '-';
+  // Parse NUMBER_PART_SIZE digits at a time from the end, in place, skipping spaces and the minus
+  int part = 0, power = 1;
+  for (size_t i = literal_length; i > 0; --i) {
+    if (!isdigit((unsigned char) literal[i - 1])) continue;
+    part += (literal[i - 1] - '0') * power;
+    power *= 10;
+    if (power == NUMBER_BASE) {
+      number_append_part(new_number, part);
+      part = 0;
+      power = 1;
+    }
+  }
+  if (power != 1)
+    number_append_part(new_number, part);
+  // Comparisons go by parts_size first, so "0000000001" must not keep a zero part
+  number_remove_leading_zeroes(new_number);
+  return new_number;
+}
+
+static number *number_from_int(number_pool *pool, int value) {
+  number *new_number = number_new(pool, 1);
+  new_number->parts[new_number->parts_size++] = abs(value);
+  new_number->is_negative = value < 0;
+  return new_number;
+}
+
+static number *number_from_number(number_pool *pool, const number *source) {
+  number *new_number = number_new(pool, source->parts_size);
+  new_number->parts_size = source->parts_size;
+  new_number->is_negative = source->is_negative;
+  memcpy(new_number->parts, source->parts, source->parts_size * sizeof(int));
+  return new_number;
+}
+
+/* Frees destination and everything after it, then moves source to its place */
+static number *number_move(number_pool *pool, number *destination, const number *source) {
+  assert(pool != NULL && destination != NULL && source != NULL && destination <= source);
+  size_t parts_size = source->parts_size;
+  bool is_negative = source->is_negative;
+  memmove(destination->parts, source->parts, parts_size * sizeof(int));
+  number_free(pool, destination);
+  // The pool is a stack, so the new number gets exactly the freed header and parts
+  number *moved_number = number_new(pool, parts_size);
+  moved_number->parts_size = parts_size;
+  moved_number->is_negative = is_negative;
+  return moved_number;
+}
+
+// Capacity is guaranteed by estimate_expression, numbers never grow
+static void number_append_part(number *number, int part) {
+  assert(number != NULL && number->parts_size < number->parts_capacity);
+  number->parts[number->parts_size++] = part;
+}
+
+static void number_remove_leading_zeroes(number *number) {
+  while (number->parts_size > 1 && number->parts[number->parts_size - 1] == 0)
+    number->parts_size--;
+}
+
+// destination should already have room for parts_size * NUMBER_PART_SIZE + 2 chars
+static void number_sprint(const number *number, string *destination) {
+  assert(number != NULL && destination != NULL);
+  if (number->is_negative && !is_number_zero(number))
+    string_add(destination, '-');
+  char buffer[NUMBER_PART_SIZE + 1];
+  sprintf(buffer, "%d", number->parts_size == 0 ? 0 : number->parts[number->parts_size - 1]);
+  string_append(destination, buffer);
+  for (int i = (int) number->parts_size - 2; i >= 0; --i) {
+    sprintf(buffer, NUMBER_PART_FORMAT, number->parts[i]);
+    string_append(destination, buffer);
+  }
+}
+
+// Also frees every number allocated after this one
+static void number_free(number_pool *pool, number *number) {
+  assert(pool != NULL && number >= pool->numbers && number < pool->numbers + pool->numbers_size);
+  pool->numbers_size = (size_t) (number - pool->numbers);
+  pool->parts_size = (size_t) (number->parts - pool->parts);
+}
+
+static bool is_number_zero(const number *number) {
+  assert(number != NULL);
+  for (size_t i = 0; i < number->parts_size; ++i)
+    if (number->parts[i] != 0)
+      return false;
+  return true;
+}
+
+static bool is_numbers_equal(const number *first, const number *second) {
+  assert(first != NULL && second != NULL);
+  if (first->parts_size != second->parts_size) return false;
+  if (first->is_negative != second->is_negative) return false;
+  for (size_t i = 0; i < first->parts_size; ++i)
+    if (first->parts[i] != second->parts[i])
+      return false;
+  return true;
+}
+
+static bool is_numbers_less(const number *first, const number *second) {
+  assert(first != NULL && second != NULL);
+  if (first->is_negative != second->is_negative)
+    return first->is_negative;
+  bool is_abs_less = is_numbers_abs_less(first, second);
+  return (first->is_negative && second->is_negative) == !is_abs_less;
+}
+
+static bool is_numbers_abs_less(const number *first, const number *second) {
+  assert(first != NULL && second != NULL);
+  if (first->parts_size != second->parts_size)
+    return first->parts_size < second->parts_size;
+  for (int i = (int) first->parts_size - 1; i >= 0; --i)
+    if (first->parts[i] != second->parts[i])
+      return first->parts[i] < second->parts[i];
+  return false;
+}
+
+static number *number_add(number_pool *pool, number *first, number *second) {
+  assert(first != NULL && second != NULL);
+
+  // a > 0, b < 0 => a+(-b) = a-b
+  if (!first->is_negative && second->is_negative) {
+    second->is_negative = false;
+    return number_subtract(pool, first, second);
+  }
+
+  // a < 0, b > 0 => (-a)+b = b-a
+  if (first->is_negative && !second->is_negative) {
+    first->is_negative = false;
+    return number_subtract(pool, second, first);
+  }
+
+  // a, b < 0 => (-a)+(-b) = -(a+b)
+  if (first->is_negative && second->is_negative) {
+    first->is_negative = second->is_negative = false;
+    number *result = number_add(pool, first, second);
+    result->is_negative = true;
+    return result;
+  }
+
+  size_t parts_size = max(first->parts_size, second->parts_size);
+  number *result = number_new(pool, parts_size + 1);
+  bool carry = 0;
+  for (size_t i = 0; i < parts_size; ++i) {
+    int part = carry + (i < first->parts_size ? first->parts[i] : 0)
+        + (i < second->parts_size ? second->parts[i] : 0);
+    carry = part >= NUMBER_BASE;
+    number_append_part(result, carry ? part - NUMBER_BASE : part);
+  }
+  if (carry)
+    number_append_part(result, 1);
+  return result;
+}
+
+static number *number_subtract(number_pool *pool, number *first, number *second) {
+  assert(first != NULL && second != NULL);
+
+  // b < 0 => a-(-b) = a+b
+  if (second->is_negative) {
+    second->is_negative = false;
+    return number_add(pool, first, second);
+  }
+
+  // a < 0 => (-a)-b = -(a+b)
+  if (first->is_negative) {
+    first->is_negative = false;
+    number *result = number_add(pool, first, second);
+    result->is_negative = !result->is_negative;
+    return result;
+  }
+
+  // a = b => a, b > 0
+  if (is_numbers_equal(first, second)) {
+    // Keep first in sync with the result, number_divide relies on it
+    first->parts_size = 1;
+    first->parts[0] = 0;
+    return number_zero(pool);
+  }
+
+  // a, b > 0, a < b => a-b = -(b-a)
+  if (is_numbers_less(first, second)) {
+    number *result = number_subtract(pool, second, first);
+    result->is_negative = true;
+    return result;
+  }
+
+  bool carry = 0;
+  for (size_t i = 0; i < second->parts_size || carry; ++i) {
+    first->parts[i] -= carry + (i < second->parts_size ? second->parts[i] : 0);
+    carry = first->parts[i] < 0;
+    if (carry)
+      first->parts[i] += NUMBER_BASE;
+  }
+  number_remove_leading_zeroes(first);
+  return number_from_number(pool, first);
+}
+
+static number *number_multiply(number_pool *pool, number *first, number *second) {
+  assert(first != NULL && second != NULL);
+  size_t result_size = first->parts_size + second->parts_size;
+  number *result = number_new(pool, result_size);
+  result->parts_size = result_size;
+  result->is_negative = first->is_negative ^ second->is_negative;
+  memset(result->parts, 0, sizeof(int) * result->parts_size);
+  for (size_t i = 0; i < first->parts_size; ++i)
+    for (int j = 0, carry = 0; j < (int) second->parts_size || carry; ++j) {
+      long long current = result->parts[i + j] + first->parts[i] * 1ll *
+          (j < (int) second->parts_size ? second->parts[j] : 0) + carry;
+      result->parts[i + j] = (int) (current % NUMBER_BASE);
+      carry = (int) (current / NUMBER_BASE);
+    }
+  number_remove_leading_zeroes(result);
+  return result;
+}
+
+static number *number_divide(number_pool *pool, number *first, number *second) {
+  assert(first != NULL && second != NULL);
+
+  if (is_number_zero(second))
+    return NULL;
+
+  if (is_numbers_abs_less(first, second))
+    return number_zero(pool);
+
+  size_t result_size = first->parts_size;
+  number *result = number_new(pool, result_size);
+  result->parts_size = result_size;
+  result->is_negative = first->is_negative ^ second->is_negative;
+  first->is_negative = second->is_negative = false;
+
+  number *current = number_new(pool, result_size);
+  // Initialize as zero
+  current->parts_size = 1;
+  memset(current->parts, 0, sizeof(int) * current->parts_capacity);
+
+  for (int i = (int) first->parts_size - 1; i >= 0; --i) {
+    // current = current * NUMBER_BASE
+    if (current->parts_size != 1 || current->parts[0] != 0) {
+      for (size_t j = current->parts_size; j > 0; --j)
+        current->parts[j] = current->parts[j - 1];
+      current->parts_size++;
+    }
+    current->parts[0] = first->parts[i];
+    // find max(x), second * x <= current
+    int x = 0, left = 0, right = NUMBER_BASE;
+    while (left <= right) {
+      int medium = (left + right) / 2;
+      number *medium_number = number_from_int(pool, medium);
+      number *second_multiply_medium = number_multiply(pool, second, medium_number);
+      bool is_fit = is_numbers_less(second_multiply_medium, current)
+          || is_numbers_equal(second_multiply_medium, current);
+      number_free(pool, medium_number);
+      if (is_fit) {
+        x = medium;
+        left = medium + 1;
+      } else {
+        right = medium - 1;
+      }
+    }
+    result->parts[i] = x;
+    number *x_number = number_from_int(pool, x);
+    number *second_multiply_x = number_multiply(pool, second, x_number);
+    number_subtract(pool, current, second_multiply_x);
+    number_free(pool, x_number);
+  }
+
+  number_remove_leading_zeroes(result);
+  number_free(pool, current);
+  return result;
+}
+
+/*
+  Shunting-yard over expression, operands go to handler. operators should have room for expression_size values.
+  operators_count, if not NULL, gets the deepest operators stack seen
+ */
+static calc_status parse_expression(const char *expression, size_t expression_size, char_stack *operators,
+                                    size_t *operators_count, const expression_handler *handler) {
+  assert(expression != NULL && operators != NULL && handler != NULL);
+
+  const char *literal = NULL;
+  size_t literal_length = 0, digits_count = 0, operands_size = 0;
+  char current, previous = '\0';
+  calc_status status = CALC_OK;
+
+  for (size_t i = 0; status == CALC_OK && i < expression_size; ++i) {
+    current = expression[i];
+    if (isdigit((unsigned char) current)) {
+      if (literal == NULL) literal = &expression[i];
+      literal_length = (size_t) (&expression[i] - literal) + 1;
+      digits_count++;
+    } else if (current == '-' && (previous == '\0' || is_operator(previous) || previous == '(')) {
+      // Unary minus can only start a literal, "--1" would be parsed as a garbage part
+      if (literal != NULL) status = CALC_ERROR_SYNTAX;
+      literal = &expression[i];
+      literal_length = 1;
+    } else if (is_operator(current)) {
+      status = parse_literal_end(&literal, &literal_length, &digits_count, &operands_size, handler);
+      while (status == CALC_OK && !is_char_stack_empty(operators) && char_stack_top(operators) != '('
+          && get_operator_precedence(char_stack_top(operators)) >= get_operator_precedence(current))
+        status = parse_expression_on_stack_top(operators, &operands_size, handler);
+      if (status != CALC_OK) break;
+      char_stack_push(operators, current);
+    } else if (current == '(') {
+      char_stack_push(operators, current);
+    } else if (current == ')') {
+      status = parse_literal_end(&literal, &literal_length, &digits_count, &operands_size, handler);
+      while (status == CALC_OK && !is_char_stack_empty(operators) && char_stack_top(operators) != '(')
+        status = parse_expression_on_stack_top(operators, &operands_size, handler);
+      if (status != CALC_OK) break;
+      if (is_char_stack_empty(operators))
+        status = CALC_ERROR_SYNTAX;
+      else
+        char_stack_pop(operators);
+    } else if (!isspace((unsigned char) current)) {
+      status = CALC_ERROR_SYNTAX;
+    }
+
+    if (operators_count != NULL)
+      *operators_count = max(*operators_count, operators->size);
+    previous = current;
+  }
+
+  if (status == CALC_OK)
+    status = parse_literal_end(&literal, &literal_length, &digits_count, &operands_size, handler);
+  while (status == CALC_OK && !is_char_stack_empty(operators))
+    status = parse_expression_on_stack_top(operators, &operands_size, handler);
+  if (status == CALC_OK && operands_size == 0)
+    status = CALC_ERROR_SYNTAX;
+  return status;
+}
+
+/* Pushes the literal read so far, a literal without digits is a lone unary minus */
+static calc_status parse_literal_end(const char **literal, size_t *literal_length, size_t *digits_count,
+                                     size_t *operands_size, const expression_handler *handler) {
+  if (*literal == NULL) return CALC_OK;
+  if (*digits_count == 0) return CALC_ERROR_SYNTAX;
+  handler->push_number(handler->data, *literal, *literal_length, *digits_count);
+  ++*operands_size;
+  *literal = NULL;
+  *literal_length = *digits_count = 0;
+  return CALC_OK;
+}
+
+static calc_status parse_expression_on_stack_top(char_stack *operators, size_t *operands_size,
+                                                 const expression_handler *handler) {
+  char operator = char_stack_top(operators);
+  if (operator == '(' || *operands_size < 2) return CALC_ERROR_SYNTAX;
+  calc_status status = handler->calculate(handler->data, operator);
+  if (status != CALC_OK) return status;
+  char_stack_pop(operators);
+  --*operands_size;
+  return CALC_OK;
+}
+
+static inline bool is_operator(char c) { return c == '+' || c == '-' || c == '*' || c == '/'; }
+
+static size_t get_operator_precedence(char operator) {
+  switch (operator) {
+    case '+':
+    case '-':return 1;
+    case '*':
+    case '/':return 2;
+    default:return 0;
+  }
+}
+
+/*
+  Runs parse_expression over digits count bounds instead of numbers, following the pool allocations of
+  evaluation on the way. operators and operands should have room for expression_size values
+ */
+static calc_status estimate_expression(const char *expression, size_t expression_size, char_stack *operators,
+                                       size_t *operands, expression_estimate *estimate) {
+  assert(expression != NULL && operators != NULL && operands != NULL && estimate != NULL);
+  *estimate = (expression_estimate) {0, 0, 0, 0};
+  estimate_stack stack = {operands, 0, 0, estimate};
+  expression_handler handler = {estimate_push_number, estimate_expression_on_stack_top, &stack};
+  calc_status status = parse_expression(expression, expression_size, operators, &estimate->operators_count,
+                                        &handler);
+  if (status == CALC_OK)
+    estimate->result_length = estimate_parts(operands[stack.operands_size - 1]) * NUMBER_PART_SIZE;
+  return status;
+}
+
+static void estimate_push_number(void *data, const char *literal, size_t literal_length, size_t digits_count) {
+  (void) literal, (void) literal_length;
+  estimate_stack *stack = data;
+  stack->operands[stack->operands_size++] = digits_count;
+  stack->parts_size += estimate_parts(digits_count);
+  stack->estimate->operands_count = max(stack->estimate->operands_count, stack->operands_size);
+  stack->estimate->parts_count = max(stack->estimate->parts_count, stack->parts_size);
+}
+
+static calc_status estimate_expression_on_stack_top(void *data, char operator) {
+  estimate_stack *stack = data;
+  size_t first_digits = stack->operands[stack->operands_size - 2];
+  size_t second_digits = stack->operands[stack->operands_size - 1];
+  size_t temporaries_parts;
+  size_t result_digits = estimate_calculate(first_digits, second_digits, operator, &temporaries_parts);
+  // Operands stay in the pool until the result is moved to the place of the first one
+  stack->estimate->parts_count = max(stack->estimate->parts_count, stack->parts_size + temporaries_parts);
+  stack->parts_size -= estimate_parts(first_digits) + estimate_parts(second_digits);
+  stack->parts_size += estimate_parts(result_digits);
+  stack->operands[--stack->operands_size - 1] = result_digits;
+  return CALC_OK;
+}
+
+/*
+  Returns result digits count bound and sets temporaries_parts to parts calculate takes from the pool
+  besides its operands. Bounds are kept in digits so a carry costs a digit rather than a whole part
+ */
+static size_t estimate_calculate(size_t first_digits, size_t second_digits, char operator,
+                                 size_t *temporaries_parts) {
+  size_t first_parts = estimate_parts(first_digits), second_parts = estimate_parts(second_digits);
+  switch (operator) {
+    case '+':
+    case '-':*temporaries_parts = max(first_parts, second_parts) + 1;
+      return max(first_digits, second_digits) + 1;
+    case '*':*temporaries_parts = first_parts + second_parts;
+      return first_digits + second_digits;
+    default:
+      // number_divide keeps result and current remainder, then x, second * x and the remainder copy
+      *temporaries_parts = 3 * first_parts + second_parts + 2;
+      return first_digits;
+  }
+}
+
+static inline size_t estimate_parts(size_t digits_count) {
+  return max((digits_count + NUMBER_PART_SIZE - 1) / NUMBER_PART_SIZE, (size_t) 1);
+}
+
+static size_t evaluation_memory_size(const expression_estimate *estimate) {
+  // Growth checks of stacks and strings keep one spare slot
+  return number_pool_memory_size(estimate->operands_count + NUMBER_POOL_TEMPORARIES, estimate->parts_count)
+      + sizeof(number *) * (estimate->operands_count + 1)
+      + sizeof(char) * (estimate->operators_count + 1)
+      + sizeof(char) * (estimate->result_length + 2);
+}
+
+static void evaluation_init(evaluation *evaluation, void *memory, const expression_estimate *estimate) {
+  // Pointers and numbers go before parts and chars to keep them aligned
+  evaluation->operands = (number_stack) {memory, 0, estimate->operands_count + 1};
+  char *chars = number_pool_init(&evaluation->pool, evaluation->operands.values + evaluation->operands.capacity,
+                                 estimate->operands_count + NUMBER_POOL_TEMPORARIES, estimate->parts_count);
+  evaluation->operators = (char_stack) {chars, 0, estimate->operators_count + 1};
+  chars += evaluation->operators.capacity;
+  evaluation->result = (string) {chars, 0, estimate->result_length + 2};
+  string_clear(&evaluation->result);
+}
+
+static calc_status evaluate_expression(const char *expression, size_t expression_size, evaluation *evaluation) {
+  assert(expression != NULL && evaluation != NULL);
+  expression_handler handler = {evaluate_push_number, calculate_expression_on_stack_top, evaluation};
+  calc_status status = parse_expression(expression, expression_size, &evaluation->operators, NULL, &handler);
+  if (status == CALC_OK)
+    number_sprint(number_stack_top(&evaluation->operands), &evaluation->result);
+  return status;
+}
+
+static void evaluate_push_number(void *data, const char *literal, size_t literal_length, size_t digits_count) {
+  evaluation *evaluation = data;
+  number_stack_push(&evaluation->operands, number_from_string(&evaluation->pool, literal, literal_length,
+                                                              digits_count));
+}
+
+static calc_status calculate_expression_on_stack_top(void *data, char operator) {
+  evaluation *evaluation = data;
+  number_pool *pool = &evaluation->pool;
+  number_stack *operands = &evaluation->operands;
+  number *first = number_stack_before_top(operands);
+  number *second = number_stack_top(operands);
+
+  number *result = calculate(pool, first, second, operator);
+  if (result == NULL) return CALC_ERROR_DIVISION_BY_ZERO;
+
+  number_stack_pop(operands);
+  number_stack_pop(operands);
+  // first is the lowest of the three in the pool, the result takes its place
+  number_stack_push(operands, number_move(pool, first, result));
+  return CALC_OK;
+}
+
+static number *calculate(number_pool *pool, number *first, number *second, char operator) {
+  assert(first != NULL && second != NULL && is_operator(operator));
+  if (operator == '+')
+    return number_add(pool, first, second);
+  if (operator == '-')
+    return number_subtract(pool, first, second);
+  if (operator == '*')
+    return number_multiply(pool, first, second);
+  if (operator == '/')
+    return number_divide(pool, first, second);
+  return NULL;
+}
+
+static void *default_allocate(size_t size, void *data) {
+  (void) data;
+  return malloc(size);
+}
+
+static void default_deallocate(void *pointer, void *data) {
+  (void) data;
+  free(pointer);
+}
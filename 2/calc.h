@@ -0,0 +1,38 @@
+/*
+  libcalc: вычисление арифметических выражений с длинной арифметикой
+
+  Библиотека не использует глобального состояния, поэтому calc_evaluate можно вызывать одновременно из разных
+  потоков. Ошибки возвращаются кодом calc_status, вся память берется через calc_allocator.
+ */
+
+#ifndef CALC_H
+#define CALC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef enum {
+  CALC_OK,
+  CALC_ERROR_SYNTAX,
+  CALC_ERROR_DIVISION_BY_ZERO,
+  CALC_ERROR_NO_MEMORY,
+  CALC_ERROR_SINK
+} calc_status;
+
+typedef struct {
+  void *(*allocate)(size_t size, void *data);
+  void (*deallocate)(void *pointer, void *data);
+  void *data;
+} calc_allocator;
+
+/* Receives the result text, returns false to abort with CALC_ERROR_SINK */
+typedef bool (*calc_sink)(const char *content, size_t size, void *data);
+
+/*
+  Evaluates expression of expression_size chars and writes the result into sink.
+  allocator can be NULL to use malloc and free. sink is called only on success
+ */
+calc_status calc_evaluate(const char *expression, size_t expression_size, const calc_allocator *allocator,
+                          calc_sink sink, void *sink_data);
+
+#endif